@@ -1,9 +1,14 @@
 #include "app.hpp"
 
+#include "benchmarkstate.hpp"
+#include "decalatlas.hpp"
 #include "gamestate.hpp"
+#include "gameobjectregistry.hpp"
 #include "editorstate.hpp"
+#include "loadgenerator.hpp"
 #include "serverstate.hpp"
 #include "spectatorghost.hpp"
+#include "tickprofiler.hpp"
 
 #include "../urhoextras/mathutils.hpp"
 
@@ -15,13 +20,25 @@
 namespace GameLib
 {
 
+char const* const SELECT_ONE_MODE_ERROR = "Please select either \"listen\", \"connect\", \"editor\", \"benchmark\" or \"loadgen\"!";
+
 App::App(Urho3D::Context* context) :
     UrhoExtras::States::StateManager(context),
     is_local(false),
     arg_server_port(0),
+    arg_server_tick_rate(0),
+    arg_server_parallel(-1),
     arg_client_port(0),
+    arg_benchmark_players(0),
+    arg_benchmark_ticks(0),
+    arg_loadgen_clients(0),
+    arg_loadgen_duration(0),
+    arg_profile_interval(0),
+    arg_netstats_interval(0),
+    gameobj_registry(NULL),
     gamestate(NULL)
 {
+    GameObjectRegistry::registerObject(context);
     SpectatorGhost::registerObject(context);
 
     try {
@@ -33,8 +50,8 @@ App::App(Urho3D::Context* context) :
         return;
     }
 
-    // If server or map conversion
-    if (arg_server_port > 0) {
+    // If server, benchmark, load generator or map conversion
+    if (arg_server_port > 0 || arg_benchmark_ticks > 0 || arg_loadgen_clients > 0) {
         initHeadless();
     }
     // If client or map editor
@@ -51,12 +68,18 @@ void App::Start()
 
     Urho3D::SetRandomSeed(Urho3D::Time::GetSystemTime());
 
+    if (arg_profile_interval > 0) {
+        TickProfiler::setEnabled(true);
+        TickProfiler::setLogInterval(arg_profile_interval);
+    }
+
     scene = new Urho3D::Scene(context_);
     scene->CreateComponent<Urho3D::Octree>(Urho3D::LOCAL);
+    gameobj_registry = scene->CreateComponent<GameObjectRegistry>(Urho3D::LOCAL);
 
     // If server
     if (arg_server_port > 0) {
-        pushState(Urho3D::SharedPtr<ServerState>(new ServerState(this, context_, arg_server_port)));
+        pushState(Urho3D::SharedPtr<ServerState>(new ServerState(this, context_, arg_server_port, arg_server_tick_rate)));
     }
     // If client
     else if (arg_client_port > 0) {
@@ -67,6 +90,16 @@ void App::Start()
     else if (!arg_editor_path.Empty()) {
         pushState(Urho3D::SharedPtr<EditorState>(new EditorState(this, context_, arg_editor_path)));
     }
+    // If benchmark
+    else if (arg_benchmark_ticks > 0) {
+        pushState(Urho3D::SharedPtr<BenchmarkState>(new BenchmarkState(this, context_, arg_benchmark_players, arg_benchmark_ticks, arg_server_tick_rate)));
+    }
+    // If load generator, then run a local server and connect synthetic clients to it
+    else if (arg_loadgen_clients > 0) {
+        Urho3D::SharedPtr<ServerState> server(new ServerState(this, context_, getDefaultPort(), arg_server_tick_rate));
+        pushState(server);
+        load_generator = new LoadGenerator(this, context_, server, arg_loadgen_clients, arg_loadgen_duration);
+    }
     // If no arguments are given, then connect to default server
     else {
         is_local = true;
@@ -79,6 +112,11 @@ Urho3D::Scene* App::getScene()
     return scene;
 }
 
+GameObjectRegistry* App::getGameObjectRegistry()
+{
+    return gameobj_registry;
+}
+
 bool App::isLocal() const
 {
     return is_local;
@@ -95,6 +133,11 @@ bool App::isStopping() const
     return engine_->IsExiting();
 }
 
+float App::getNetworkStatsLogInterval() const
+{
+    return arg_netstats_interval;
+}
+
 void App::initializeSceneOnServer()
 {
 }
@@ -122,6 +165,89 @@ Urho3D::Node* App::createNodeAndGameObjectForPlayer()
     return node;
 }
 
+bool App::useParallelServerTick() const
+{
+    return false;
+}
+
+bool App::getParallelServerTick() const
+{
+    if (arg_server_parallel >= 0) {
+        return arg_server_parallel > 0;
+    }
+    return useParallelServerTick();
+}
+
+float App::getLagCompensationHistoryLength() const
+{
+    return 1;
+}
+
+unsigned App::getMaxLagCompensatedGameObjects() const
+{
+    return 64;
+}
+
+unsigned App::getMaxDecals() const
+{
+    return 10000;
+}
+
+unsigned App::getMaxDecalMemory() const
+{
+    return 16 * 1024 * 1024;
+}
+
+float App::getDecalTimeBudget() const
+{
+    return 0.002f;
+}
+
+unsigned App::getMaxDecalTargetTriangles() const
+{
+    return 10000;
+}
+
+float App::getDecalDrawDistance() const
+{
+    return getFogEndDistance();
+}
+
+float App::getInterpolationDelay() const
+{
+    return 0.05;
+}
+
+float App::getMaxExtrapolation() const
+{
+    return 0.25;
+}
+
+float App::getClientFullTickDistance() const
+{
+    return getFogEndDistance();
+}
+
+float App::getClientReducedTickInterval() const
+{
+    return 0.25;
+}
+
+float App::getAddGameObjectsTimeBudget() const
+{
+    return 0.005;
+}
+
+float App::getRelevanceDistance() const
+{
+    return getFogEndDistance();
+}
+
+float App::getRelevanceHysteresis() const
+{
+    return getFogEndDistance() * 0.25f;
+}
+
 void App::getClientNetworkEvents(Urho3D::Vector<Urho3D::StringHash>& result)
 {
     (void)result;
@@ -208,18 +334,29 @@ void App::addDecalToGameObjects(Urho3D::Material* mat, Urho3D::Vector3 const& po
     Urho3D::Frustum frustum;
     frustum.DefineOrtho(size, aspect, 1.0, 0.0f, depth, frustum_transf);
 
-    // Iterate all GameObjects and try to add decal to them
-    Urho3D::PODVector<Urho3D::Node*> children = scene->GetChildren(false);
-    for (unsigned child_i = 0; child_i < children.Size(); ++ child_i) {
-        Urho3D::Node* child_node = children[child_i];
-        for (unsigned comp_i = 0; comp_i < child_node->GetNumComponents(); ++ comp_i) {
-            Urho3D::Component* component = child_node->GetComponents()[comp_i];
-            GameObject* gameobj = dynamic_cast<GameObject*>(component);
-            if (gameobj && gameobj->receiveDecals()) {
-                gamestate->addDecalsRecursively(child_node, frustum, mat, pos, rot, size, aspect, depth, uv_begin, uv_end);
-            }
-        }
+    gamestate->addDecals(frustum, mat, pos, rot, size, aspect, depth, uv_begin, uv_end);
+}
+
+void App::setDecalAtlas(DecalAtlas* decal_atlas)
+{
+    this->decal_atlas = decal_atlas;
+}
+
+DecalAtlas* App::getDecalAtlas() const
+{
+    return decal_atlas;
+}
+
+void App::addDecalToGameObjects(Urho3D::String const& decal, Urho3D::Vector3 const& pos, Urho3D::Vector3 const& dir, float size, float depth)
+{
+    Urho3D::Vector2 uv_begin;
+    Urho3D::Vector2 uv_end;
+    float aspect;
+    if (!decal_atlas || !decal_atlas->getDecal(uv_begin, uv_end, aspect, decal)) {
+        URHO3D_LOGERRORF("Decal \"%s\" not found from decal atlas!", decal.CString());
+        return;
     }
+    addDecalToGameObjects(decal_atlas->getMaterial(), pos, dir, size, aspect, depth, uv_begin, uv_end);
 }
 
 void App::setGameState(GameState* gamestate)
@@ -239,8 +376,8 @@ void App::readArguments()
                 if (arg_server_port > 0) {
                     throw std::runtime_error("Duplicate \"listen\"!");
                 }
-                if (arg_client_port > 0 || !arg_editor_path.Empty()) {
-                    throw std::runtime_error("Please select either \"listen\", \"connect\" or \"editor\"!");
+                if (isModeSelected()) {
+                    throw std::runtime_error(SELECT_ONE_MODE_ERROR);
                 }
                 if (args.Size() - i < 2) {
                     throw std::runtime_error("Missing port!");
@@ -251,13 +388,44 @@ void App::readArguments()
                 }
                 ++ i;
             }
+            // Fixed tick rate for server
+            else if (arg == "tickrate") {
+                if (arg_server_tick_rate > 0) {
+                    throw std::runtime_error("Duplicate \"tickrate\"!");
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing tick rate!");
+                }
+                arg_server_tick_rate = Urho3D::ToInt(args[i + 1]);
+                if (arg_server_tick_rate < 1 || arg_server_tick_rate > 1000) {
+                    throw std::runtime_error("Tick rate must be between 1 and 1000!");
+                }
+                ++ i;
+            }
+            // Parallel server tick
+            else if (arg == "parallel") {
+                if (arg_server_parallel >= 0) {
+                    throw std::runtime_error("Duplicate \"parallel\"!");
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing \"on\" or \"off\" for parallel!");
+                }
+                if (args[i + 1] == "on") {
+                    arg_server_parallel = 1;
+                } else if (args[i + 1] == "off") {
+                    arg_server_parallel = 0;
+                } else {
+                    throw std::runtime_error("Parallel must be either \"on\" or \"off\"!");
+                }
+                ++ i;
+            }
             // Client
             else if (arg == "connect") {
                 if (arg_client_port > 0) {
                     throw std::runtime_error("Duplicate \"connect\"!");
                 }
-                if (arg_server_port > 0 || !arg_editor_path.Empty()) {
-                    throw std::runtime_error("Please select either \"listen\", \"connect\" or \"editor\"!");
+                if (isModeSelected()) {
+                    throw std::runtime_error(SELECT_ONE_MODE_ERROR);
                 }
                 if (args.Size() - i < 2) {
                     throw std::runtime_error("Missing hostname and port!");
@@ -277,8 +445,8 @@ void App::readArguments()
                 if (!arg_editor_path.Empty()) {
                     throw std::runtime_error("Duplicate \"editor\"!");
                 }
-                if (arg_server_port > 0 || arg_client_port > 0) {
-                    throw std::runtime_error("Please select either \"listen\", \"connect\" or \"editor\"!");
+                if (isModeSelected()) {
+                    throw std::runtime_error(SELECT_ONE_MODE_ERROR);
                 }
                 if (args.Size() - i < 2) {
                     throw std::runtime_error("Missing scene path!");
@@ -286,24 +454,126 @@ void App::readArguments()
                 arg_editor_path = args[i + 1];
                 i += 1;
             }
+            // Server tick benchmark
+            else if (arg == "benchmark") {
+                if (arg_benchmark_ticks > 0) {
+                    throw std::runtime_error("Duplicate \"benchmark\"!");
+                }
+                if (isModeSelected()) {
+                    throw std::runtime_error(SELECT_ONE_MODE_ERROR);
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing amount of players and ticks!");
+                }
+                if (args.Size() - i < 3) {
+                    throw std::runtime_error("Missing amount of ticks!");
+                }
+                arg_benchmark_players = Urho3D::ToInt(args[i + 1]);
+                arg_benchmark_ticks = Urho3D::ToInt(args[i + 2]);
+                if (arg_benchmark_players < 0) {
+                    throw std::runtime_error("Amount of players must not be negative!");
+                }
+                if (arg_benchmark_ticks < 1) {
+                    throw std::runtime_error("Amount of ticks must be positive!");
+                }
+                i += 2;
+            }
+            // Load generator
+            else if (arg == "loadgen") {
+                if (arg_loadgen_clients > 0) {
+                    throw std::runtime_error("Duplicate \"loadgen\"!");
+                }
+                if (isModeSelected()) {
+                    throw std::runtime_error(SELECT_ONE_MODE_ERROR);
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing amount of clients and duration!");
+                }
+                if (args.Size() - i < 3) {
+                    throw std::runtime_error("Missing duration!");
+                }
+                arg_loadgen_clients = Urho3D::ToInt(args[i + 1]);
+                arg_loadgen_duration = Urho3D::ToFloat(args[i + 2]);
+                if (arg_loadgen_clients < 1) {
+                    throw std::runtime_error("Amount of clients must be positive!");
+                }
+                if (arg_loadgen_duration <= 0) {
+                    throw std::runtime_error("Duration must be positive!");
+                }
+                i += 2;
+            }
+            // Tick profiler
+            else if (arg == "profile") {
+                if (arg_profile_interval > 0) {
+                    throw std::runtime_error("Duplicate \"profile\"!");
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing profile log interval!");
+                }
+                arg_profile_interval = Urho3D::ToFloat(args[i + 1]);
+                if (arg_profile_interval <= 0) {
+                    throw std::runtime_error("Profile log interval must be positive!");
+                }
+                ++ i;
+            }
+            // Network statistics
+            else if (arg == "netstats") {
+                if (arg_netstats_interval > 0) {
+                    throw std::runtime_error("Duplicate \"netstats\"!");
+                }
+                if (args.Size() - i < 2) {
+                    throw std::runtime_error("Missing network statistics log interval!");
+                }
+                arg_netstats_interval = Urho3D::ToFloat(args[i + 1]);
+                if (arg_netstats_interval <= 0) {
+                    throw std::runtime_error("Network statistics log interval must be positive!");
+                }
+                ++ i;
+            }
             // Unexpected argument
             else {
                 throw std::runtime_error("Invalid arguments!");
             }
         }
+        if (arg_server_tick_rate > 0 && arg_server_port == 0 && arg_benchmark_ticks == 0 && arg_loadgen_clients == 0) {
+            throw std::runtime_error("\"tickrate\" can only be used with \"listen\", \"benchmark\" or \"loadgen\"!");
+        }
+        if (arg_server_parallel >= 0 && arg_server_port == 0 && arg_benchmark_ticks == 0 && arg_loadgen_clients == 0) {
+            throw std::runtime_error("\"parallel\" can only be used with \"listen\", \"benchmark\" or \"loadgen\"!");
+        }
     } catch (std::runtime_error const& err) {
         // In case of error, reset settings
         arg_client_host.Clear();
         arg_client_port = 0;
         arg_server_port = 0;
+        arg_server_tick_rate = 0;
+        arg_server_parallel = -1;
+        arg_profile_interval = 0;
+        arg_netstats_interval = 0;
         arg_editor_path.Clear();
+        arg_benchmark_players = 0;
+        arg_benchmark_ticks = 0;
+        arg_loadgen_clients = 0;
+        arg_loadgen_duration = 0;
         throw;
     }
 }
 
+bool App::isModeSelected() const
+{
+    return arg_server_port > 0 || arg_client_port > 0 || !arg_editor_path.Empty() || arg_benchmark_ticks > 0 || arg_loadgen_clients > 0;
+}
+
 void App::initHeadless()
 {
     engineParameters_["Headless"] = true;
+
+    // With fixed tick rate, do not run frames faster than ticks. Headless
+    // engine never has input focus, so inactive limit must be set as well.
+    if (arg_server_tick_rate > 0) {
+        engine_->SetMaxFps(arg_server_tick_rate);
+        engine_->SetMaxInactiveFps(arg_server_tick_rate);
+    }
 }
 
 void App::initWindow()
@@ -11,7 +11,10 @@
 namespace GameLib
 {
 
+class DecalAtlas;
+class GameObjectRegistry;
 class GameState;
+class LoadGenerator;
 
 class App : public UrhoExtras::States::StateManager
 {
@@ -24,12 +27,17 @@ public:
 
     Urho3D::Scene* getScene();
 
+    GameObjectRegistry* getGameObjectRegistry();
+
     bool isLocal() const;
 
     void stop();
 
     bool isStopping() const;
 
+    // Seconds between network statistics in log, or zero if they are not logged
+    float getNetworkStatsLogInterval() const;
+
     virtual void initializeSceneOnServer();
     virtual void initializeSceneOnClient();
 
@@ -39,6 +47,57 @@ public:
 
     virtual Urho3D::Node* createNodeAndGameObjectForPlayer();
 
+    // If enabled, server runs GameObjects that are marked to
+    // run in parallel using worker threads of WorkQueue.
+    virtual bool useParallelServerTick() const;
+    // Returns useParallelServerTick(), unless "parallel" was given
+    // on command line. This is what ServerState uses.
+    bool getParallelServerTick() const;
+
+    // How many seconds of history server keeps for lag compensated
+    // hitscans, and how many GameObjects can be compensated.
+    virtual float getLagCompensationHistoryLength() const;
+    virtual unsigned getMaxLagCompensatedGameObjects() const;
+
+    // Limits for decals on client. When either is exceeded, the oldest
+    // decals are removed. Memory is in bytes of decal geometry.
+    virtual unsigned getMaxDecals() const;
+    virtual unsigned getMaxDecalMemory() const;
+    // How many seconds per frame client may spend on clipping decal geometry
+    virtual float getDecalTimeBudget() const;
+    // Decals are not added to geometry that has more triangles than this,
+    // because clipping even one decal against it would take too long.
+    // Clipping is done on the main thread, at roughly 100 ns per triangle,
+    // so by default one decal takes at most about half of the time budget.
+    virtual unsigned getMaxDecalTargetTriangles() const;
+    // Decals farther than this from camera are not created, and existing
+    // decals are not drawn. By default this is where fog ends, because
+    // only there fog has hidden decals completely, so they do not pop.
+    virtual float getDecalDrawDistance() const;
+
+    // Other than controlled Nodes are shown this many seconds behind the
+    // latest network update on client, plus one update interval and some
+    // extra if updates arrive unevenly. If updates stop, Nodes keep moving
+    // for at most the max extrapolation seconds.
+    virtual float getInterpolationDelay() const;
+    virtual float getMaxExtrapolation() const;
+
+    // GameObjects that are visible and nearer than given distance are run
+    // every frame on client. Others are run once per given interval.
+    virtual float getClientFullTickDistance() const;
+    virtual float getClientReducedTickInterval() const;
+    // How many seconds per frame client may spend on handleAddedToClient()
+    // of GameObjects. This matters when joining, because then all of
+    // them are added at once.
+    virtual float getAddGameObjectsTimeBudget() const;
+
+    // Server sends updates of Nodes nearer than relevance distance to the
+    // controlled Node of client every time. Over the hysteresis distance
+    // beyond that, updates are sent less and less often, so Nodes that
+    // move back and forth at the border do not keep stopping and starting.
+    virtual float getRelevanceDistance() const;
+    virtual float getRelevanceHysteresis() const;
+
     virtual void getClientNetworkEvents(Urho3D::Vector<Urho3D::StringHash>& result);
     virtual void handleClientNetworkEvent(Urho3D::StringHash const& event_type, Urho3D::VariantMap& event_data);
     virtual void getServerNetworkEvents(Urho3D::Vector<Urho3D::StringHash>& result);
@@ -58,6 +117,13 @@ public:
     void addDecalToGameObjects(Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Vector3 const& dir, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
     void addDecalToGameObjects(Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
 
+    // Decals from atlas share one Material, so they are added to the same
+    // DecalSets. Atlas should be built before it is set. Aspect ratio of
+    // the decal comes from its image.
+    void setDecalAtlas(DecalAtlas* decal_atlas);
+    DecalAtlas* getDecalAtlas() const;
+    void addDecalToGameObjects(Urho3D::String const& decal, Urho3D::Vector3 const& pos, Urho3D::Vector3 const& dir, float size, float depth);
+
     // This is called by GameState
     void setGameState(GameState* gamestate);
 
@@ -68,17 +134,36 @@ private:
     // Arguments from command line
     // For server
     int arg_server_port;
+    int arg_server_tick_rate;
+    // Negative if not given
+    int arg_server_parallel;
     // For client
     Urho3D::String arg_client_host;
     int arg_client_port;
     // For editor
     Urho3D::String arg_editor_path;
+    // For benchmark
+    int arg_benchmark_players;
+    int arg_benchmark_ticks;
+    // For load generator
+    int arg_loadgen_clients;
+    float arg_loadgen_duration;
+    // For profiling
+    float arg_profile_interval;
+    float arg_netstats_interval;
 
     Urho3D::SharedPtr<Urho3D::Scene> scene;
+    GameObjectRegistry* gameobj_registry;
 
     GameState* gamestate;
 
+    Urho3D::SharedPtr<DecalAtlas> decal_atlas;
+
+    Urho3D::SharedPtr<LoadGenerator> load_generator;
+
     void readArguments();
+    // Returns true if server, client, editor, benchmark or load generator is selected
+    bool isModeSelected() const;
 
     void initHeadless();
     void initWindow();
@@ -0,0 +1,182 @@
+#include "benchmarkstate.hpp"
+
+#include "app.hpp"
+#include "gameobjectregistry.hpp"
+#include "network.hpp"
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+
+#include <chrono>
+
+#ifdef GAMELIB_COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#endif
+
+#ifdef GAMELIB_COUNT_ALLOCATIONS
+// Count every allocation of the process, so allocations per tick can be reported
+static std::atomic<uint64_t> allocations_count(0);
+
+void* operator new(std::size_t size)
+{
+    ++ allocations_count;
+    void* ptr = std::malloc(size > 0 ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t size) noexcept
+{
+    (void)size;
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t size) noexcept
+{
+    (void)size;
+    std::free(ptr);
+}
+#endif
+
+namespace GameLib
+{
+
+// Ticks that are run before measuring, so caches and pools are warmed up
+unsigned const WARMUP_TICKS = 60;
+
+BenchmarkState::BenchmarkState(App* app, Urho3D::Context* context, unsigned players_count, unsigned ticks, unsigned tick_rate) :
+    UrhoExtras::States::State(context),
+    app(app),
+    players_count(players_count),
+    ticks(ticks),
+    tick_length(1.0f / (tick_rate > 0 ? tick_rate : 60))
+{
+    // Server is not pushed to StateManager, because its update is driven from here
+    server = new ServerState(app, context, 0, tick_rate);
+}
+
+void BenchmarkState::show()
+{
+    SubscribeToEvent(Urho3D::E_UPDATE, URHO3D_HANDLER(BenchmarkState, handleUpdate));
+}
+
+void BenchmarkState::hide()
+{
+    UnsubscribeFromEvent(Urho3D::E_UPDATE);
+}
+
+void BenchmarkState::removed()
+{
+    if (server) {
+        server->removed();
+        server = nullptr;
+    }
+}
+
+void BenchmarkState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+    (void)event_data;
+
+    // Everything is run during the first frame
+    UnsubscribeFromEvent(Urho3D::E_UPDATE);
+
+    if (app->isStopping()) {
+        return;
+    }
+
+    // Measure with 1, 2, 4, ... players, and finally with all of them
+    unsigned step_players = Urho3D::Min(players_count, 1u);
+    while (true) {
+        while (players.Size() < step_players) {
+            players.Push(server->addLocalPlayer());
+        }
+        runStep();
+        if (step_players >= players_count) {
+            break;
+        }
+        step_players = Urho3D::Min(step_players * 2, players_count);
+    }
+
+    app->stop();
+}
+
+void BenchmarkState::runStep()
+{
+    runTicks(WARMUP_TICKS, 0);
+
+    #ifdef GAMELIB_COUNT_ALLOCATIONS
+    uint64_t allocations_at_begin = allocations_count;
+    #endif
+
+    uint64_t nanoseconds = runTicks(ticks, WARMUP_TICKS);
+
+    Urho3D::String allocations_per_tick = "null";
+    #ifdef GAMELIB_COUNT_ALLOCATIONS
+    allocations_per_tick = Urho3D::String(double(allocations_count - allocations_at_begin) / ticks);
+    #endif
+
+    unsigned gameobjs_count = app->getGameObjectRegistry()->getNumGameObjects();
+
+    Urho3D::String result;
+    result.AppendWithFormat(
+        "{\"players\": %u, \"gameobjects\": %u, \"parallel\": %s, \"ticks\": %u, \"tick_length\": %g, \"ns_per_tick\": %.1f, \"ns_per_gameobject_per_tick\": %.2f, \"allocations_per_tick\": %s}",
+        players.Size(), gameobjs_count, app->getParallelServerTick() ? "true" : "false", ticks, tick_length,
+        double(nanoseconds) / ticks,
+        gameobjs_count > 0 ? double(nanoseconds) / ticks / gameobjs_count : 0.0,
+        allocations_per_tick.CString()
+    );
+    Urho3D::PrintLine(result);
+}
+
+uint64_t BenchmarkState::runTicks(unsigned ticks_to_run, unsigned first_tick)
+{
+    uint64_t nanoseconds = 0;
+    for (unsigned tick = first_tick; tick < first_tick + ticks_to_run; ++ tick) {
+        // Setting controls is not part of the measurement
+        setSyntheticControls(tick);
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        server->runTick(tick_length);
+        nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+    return nanoseconds;
+}
+
+void BenchmarkState::setSyntheticControls(unsigned tick)
+{
+    // Every player moves forward while slowly turning, and
+    // changes its vertical direction once per few seconds.
+    for (unsigned i = 0; i < players.Size(); ++ i) {
+        Urho3D::Controls& controls = players[i]->controls;
+        controls.buttons_ = CTRL_FORWARD;
+        if ((tick / 120 + i) % 2 == 0) {
+            controls.buttons_ |= CTRL_JUMP;
+        } else {
+            controls.buttons_ |= CTRL_CROUCH;
+        }
+        controls.yaw_ = float((i * 37 + tick) % 360);
+        controls.pitch_ = 0;
+    }
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef GAMELIB_BENCHMARKSTATE_HPP
+#define GAMELIB_BENCHMARKSTATE_HPP
+
+#include "serverstate.hpp"
+
+#include "../urhoextras/states/state.hpp"
+
+#include <cstdint>
+
+namespace GameLib
+{
+
+class App;
+
+// Measures the cost of server ticks without networking. Spawns players without
+// connection, gives them synthetic controls and then runs the tick of
+// ServerState as fast as possible. Player count is doubled from one until the
+// given amount is reached, so the results show how tick time grows with
+// players. Every player count is printed as one line of JSON, after which the
+// App is stopped. Run with "parallel on" and "parallel off" to compare.
+class BenchmarkState : public UrhoExtras::States::State
+{
+
+public:
+
+    // If tick rate is zero, then ticks are 1/60 seconds long
+    BenchmarkState(App* app, Urho3D::Context* context, unsigned players_count, unsigned ticks, unsigned tick_rate);
+
+    void show() override;
+    void hide() override;
+    void removed() override;
+
+private:
+
+    typedef Urho3D::PODVector<Player*> Players;
+
+    App* app;
+
+    unsigned players_count;
+    unsigned ticks;
+    float tick_length;
+
+    Urho3D::SharedPtr<ServerState> server;
+    Players players;
+
+    void handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+
+    // Measures ticks with current players and prints the result
+    void runStep();
+
+    // Runs given amount of ticks and returns how many nanoseconds it took
+    uint64_t runTicks(unsigned ticks_to_run, unsigned first_tick);
+
+    void setSyntheticControls(unsigned tick);
+};
+
+}
+
+#endif
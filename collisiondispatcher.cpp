@@ -0,0 +1,102 @@
+#include "collisiondispatcher.hpp"
+
+#include "gameobject.hpp"
+#include "gameobjectregistry.hpp"
+#include "tickprofiler.hpp"
+
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+
+#include <cstring>
+
+namespace GameLib
+{
+
+static_assert(sizeof(PhysicsContact) == 8 * sizeof(float), "PhysicsContact must match the layout of contact buffers!");
+
+CollisionDispatcher::CollisionDispatcher(Urho3D::Context* context, GameObjectRegistry* registry) :
+    Urho3D::Object(context),
+    registry(registry),
+    enabled(false)
+{
+}
+
+void CollisionDispatcher::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+    if (enabled) {
+        SubscribeToEvent(Urho3D::E_PHYSICSCOLLISION, URHO3D_HANDLER(CollisionDispatcher, handlePhysicsCollision));
+    } else {
+        UnsubscribeFromEvent(Urho3D::E_PHYSICSCOLLISION);
+    }
+}
+
+bool CollisionDispatcher::isEnabled() const
+{
+    return enabled;
+}
+
+void CollisionDispatcher::handlePhysicsCollision(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    // Only collisions of this Scene
+    Urho3D::PhysicsWorld* world = static_cast<Urho3D::PhysicsWorld*>(event_data[Urho3D::PhysicsCollision::P_WORLD].GetPtr());
+    if (!world || world->GetScene() != registry->GetScene()) {
+        return;
+    }
+
+    // Find closest GameObjects of both Nodes. If neither
+    // of them is interested, then contacts are not read.
+    Urho3D::Node* node_a = static_cast<Urho3D::Node*>(event_data[Urho3D::PhysicsCollision::P_NODEA].GetPtr());
+    Urho3D::Node* node_b = static_cast<Urho3D::Node*>(event_data[Urho3D::PhysicsCollision::P_NODEB].GetPtr());
+    GameObject* obj_a = registry->findGameObject(node_a);
+    GameObject* obj_b = registry->findGameObject(node_b);
+    bool a_handles = obj_a && obj_a->getHandlesPhysicsCollisions();
+    bool b_handles = obj_b && obj_b->getHandlesPhysicsCollisions();
+    if (!a_handles && !b_handles) {
+        return;
+    }
+
+    // Collisions wake GameObjects
+    if (obj_a) {
+        obj_a->wake();
+    }
+    if (obj_b) {
+        obj_b->wake();
+    }
+
+    // If Node belongs to a GameObject, then report the Node of that
+    // GameObject. Handling the collision might destroy either of them.
+    Urho3D::WeakPtr<GameObject> weak_obj_a(obj_a);
+    Urho3D::WeakPtr<GameObject> weak_obj_b(obj_b);
+    Urho3D::WeakPtr<Urho3D::Node> weak_node_a(obj_a ? obj_a->GetNode() : node_a);
+    Urho3D::WeakPtr<Urho3D::Node> weak_node_b(obj_b ? obj_b->GetNode() : node_b);
+
+    // Contacts are stored as Vector3, Vector3, float and float, so they are
+    // copied as they are. Buffer of bytes cannot be used as PhysicsContacts
+    // directly, because of alignment and aliasing. Normals point from B
+    // towards A. Handlers might cause more collisions, so the copy is local.
+    Urho3D::PODVector<unsigned char> const& contacts_data = event_data[Urho3D::PhysicsCollision::P_CONTACTS].GetBuffer();
+    unsigned contacts_count = contacts_data.Size() / sizeof(PhysicsContact);
+    if (!contacts_count) {
+        return;
+    }
+    Urho3D::PODVector<PhysicsContact> contacts(contacts_count);
+    std::memcpy(contacts.Buffer(), contacts_data.Buffer(), contacts_count * sizeof(PhysicsContact));
+
+    if (a_handles) {
+        TickProfiler::Scope profile(obj_a, TickProfiler::HANDLE_PHYSICS_COLLISION);
+        obj_a->handlePhysicsCollisions(contacts.Buffer(), contacts_count, weak_node_b, weak_obj_b);
+    }
+    if (b_handles && weak_obj_b) {
+        // From the point of view of B, normals point the other way
+        for (PhysicsContact& contact : contacts) {
+            contact.normal = -contact.normal;
+        }
+        TickProfiler::Scope profile(obj_b, TickProfiler::HANDLE_PHYSICS_COLLISION);
+        obj_b->handlePhysicsCollisions(contacts.Buffer(), contacts_count, weak_node_a, weak_obj_a);
+    }
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef GAMELIB_COLLISIONDISPATCHER_HPP
+#define GAMELIB_COLLISIONDISPATCHER_HPP
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Object.h>
+
+namespace GameLib
+{
+
+class GameObjectRegistry;
+
+// Reports physics collisions of the Scene of GameObjectRegistry to the
+// GameObjects that are interested about them. Every collision is reported
+// to the closest GameObject of both colliding Nodes.
+class CollisionDispatcher : public Urho3D::Object
+{
+    URHO3D_OBJECT(CollisionDispatcher, Urho3D::Object);
+
+public:
+
+    CollisionDispatcher(Urho3D::Context* context, GameObjectRegistry* registry);
+
+    // Disabled by default. This is enabled by ServerState.
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+private:
+
+    GameObjectRegistry* registry;
+
+    bool enabled;
+
+    void handlePhysicsCollision(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+};
+
+}
+
+#endif
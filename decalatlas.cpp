@@ -0,0 +1,148 @@
+#include "decalatlas.hpp"
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+namespace GameLib
+{
+
+// Texel of mip level N covers 2^N pixels, and filtering also reads its
+// neighbour, so edge pixels are repeated this much around every image to
+// keep the first mip levels from bleeding between decals. Smaller mip
+// levels would bleed, so they are not created.
+unsigned const MIP_LEVELS = 3;
+int const PADDING = 1 << MIP_LEVELS;
+
+unsigned const MIN_SIZE = 256;
+
+static bool compareDecalHeights(Urho3D::Image* a, Urho3D::Image* b)
+{
+    return a->GetHeight() > b->GetHeight();
+}
+
+DecalAtlas::DecalAtlas(Urho3D::Context* context) :
+    Urho3D::Object(context),
+    width(0),
+    height(0)
+{
+}
+
+DecalAtlas::~DecalAtlas()
+{
+}
+
+bool DecalAtlas::addImage(Urho3D::String const& name, Urho3D::Image* image)
+{
+    if (!image || image->IsCompressed()) {
+        URHO3D_LOGERRORF("Decal image \"%s\" is missing or compressed!", name.CString());
+        return false;
+    }
+    Decal& decal = decals[name];
+    decal.image = image;
+    return true;
+}
+
+bool DecalAtlas::addImage(Urho3D::String const& name, Urho3D::String const& image_path)
+{
+    Urho3D::ResourceCache* resources = GetSubsystem<Urho3D::ResourceCache>();
+    return addImage(name, resources->GetResource<Urho3D::Image>(image_path));
+}
+
+bool DecalAtlas::build(Urho3D::Material* base_material, unsigned max_size)
+{
+    // Find the smallest size that fits
+    unsigned size = MIN_SIZE;
+    while (!pack(size)) {
+        size *= 2;
+        if (size > max_size) {
+            URHO3D_LOGERROR("Decal images do not fit in atlas!");
+            return false;
+        }
+    }
+
+    // Copy images, including padding
+    Urho3D::SharedPtr<Urho3D::Image> atlas_image(new Urho3D::Image(context_));
+    atlas_image->SetSize(width, height, 4);
+    atlas_image->Clear(Urho3D::Color::TRANSPARENT);
+    for (Decals::Iterator i = decals.Begin(); i != decals.End(); ++ i) {
+        Decal& decal = i->second_;
+        Urho3D::Image* image = decal.image;
+        int image_width = image->GetWidth();
+        int image_height = image->GetHeight();
+        for (int y = -PADDING; y < image_height + PADDING; ++ y) {
+            for (int x = -PADDING; x < image_width + PADDING; ++ x) {
+                int src_x = Urho3D::Clamp(x, 0, image_width - 1);
+                int src_y = Urho3D::Clamp(y, 0, image_height - 1);
+                atlas_image->SetPixel(decal.rect.left_ + x, decal.rect.top_ + y, image->GetPixel(src_x, src_y));
+            }
+        }
+    }
+
+    Urho3D::SharedPtr<Urho3D::Texture2D> texture(new Urho3D::Texture2D(context_));
+    texture->SetNumLevels(MIP_LEVELS);
+    texture->SetData(atlas_image, true);
+
+    mat = base_material->Clone();
+    mat->SetTexture(Urho3D::TU_DIFFUSE, texture);
+
+    return true;
+}
+
+Urho3D::Material* DecalAtlas::getMaterial() const
+{
+    return mat;
+}
+
+bool DecalAtlas::getDecal(Urho3D::Vector2& result_uv_begin, Urho3D::Vector2& result_uv_end, float& result_aspect, Urho3D::String const& name) const
+{
+    Decals::ConstIterator decals_find = decals.Find(name);
+    if (!mat || decals_find == decals.End()) {
+        return false;
+    }
+    Urho3D::IntRect const& rect = decals_find->second_.rect;
+    result_uv_begin = Urho3D::Vector2(float(rect.left_) / width, float(rect.top_) / height);
+    result_uv_end = Urho3D::Vector2(float(rect.right_) / width, float(rect.bottom_) / height);
+    result_aspect = float(rect.Width()) / rect.Height();
+    return true;
+}
+
+bool DecalAtlas::pack(unsigned size)
+{
+    Urho3D::PODVector<Urho3D::Image*> images;
+    for (Decals::Iterator i = decals.Begin(); i != decals.End(); ++ i) {
+        images.Push(i->second_.image);
+    }
+    Urho3D::Sort(images.Begin(), images.End(), compareDecalHeights);
+
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+    Urho3D::HashMap<Urho3D::Image*, Urho3D::IntRect> rects;
+    for (Urho3D::Image* image : images) {
+        int cell_width = image->GetWidth() + PADDING * 2;
+        int cell_height = image->GetHeight() + PADDING * 2;
+        // Start a new row if this does not fit to the current one
+        if (x + cell_width > int(size)) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+        if (x + cell_width > int(size) || y + cell_height > int(size)) {
+            return false;
+        }
+        rects[image] = Urho3D::IntRect(x + PADDING, y + PADDING, x + cell_width - PADDING, y + cell_height - PADDING);
+        x += cell_width;
+        row_height = Urho3D::Max(row_height, cell_height);
+    }
+
+    for (Decals::Iterator i = decals.Begin(); i != decals.End(); ++ i) {
+        i->second_.rect = rects[i->second_.image];
+    }
+    width = size;
+    height = Urho3D::NextPowerOfTwo(unsigned(Urho3D::Max(y + row_height, 1)));
+    return true;
+}
+
+}
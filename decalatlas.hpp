@@ -0,0 +1,63 @@
+#ifndef GAMELIB_DECALATLAS_HPP
+#define GAMELIB_DECALATLAS_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Resource/Image.h>
+
+namespace GameLib
+{
+
+// Packs images of different kinds of decals into one texture, so they can
+// share one Material. Then any kinds of decals can be put on a Node with a
+// single DecalSet, and they are drawn with a single draw call. Decals are
+// selected with texture coordinates. Atlas is usually built once, at startup.
+class DecalAtlas : public Urho3D::Object
+{
+    URHO3D_OBJECT(DecalAtlas, Urho3D::Object);
+
+public:
+
+    DecalAtlas(Urho3D::Context* context);
+    virtual ~DecalAtlas();
+
+    // Adds image to be packed. Returns false if image could not be loaded.
+    bool addImage(Urho3D::String const& name, Urho3D::Image* image);
+    bool addImage(Urho3D::String const& name, Urho3D::String const& image_path);
+
+    // Packs images to a texture of given maximum size and uses it as the
+    // diffuse texture of a clone of given Material. Images are kept, so
+    // more can be added and the atlas built again, but Materials from
+    // earlier builds are not updated. Returns false if images do not fit.
+    bool build(Urho3D::Material* base_material, unsigned max_size = 4096);
+
+    // Returns null until built
+    Urho3D::Material* getMaterial() const;
+
+    // Returns false if there is no such decal
+    bool getDecal(Urho3D::Vector2& result_uv_begin, Urho3D::Vector2& result_uv_end, float& result_aspect, Urho3D::String const& name) const;
+
+private:
+
+    struct Decal
+    {
+        Urho3D::SharedPtr<Urho3D::Image> image;
+        Urho3D::IntRect rect;
+    };
+
+    typedef Urho3D::HashMap<Urho3D::String, Decal> Decals;
+
+    Decals decals;
+    unsigned width;
+    unsigned height;
+
+    Urho3D::SharedPtr<Urho3D::Material> mat;
+
+    // Places images in rows, tallest first. Returns false if they do not fit.
+    bool pack(unsigned size);
+};
+
+}
+
+#endif
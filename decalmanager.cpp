@@ -0,0 +1,320 @@
+#include "decalmanager.hpp"
+
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Scene/Node.h>
+
+#include <cassert>
+#include <chrono>
+
+namespace GameLib
+{
+
+// Position, normal, texture coordinate and tangent
+unsigned const DECAL_VERTEX_SIZE = 12 + 12 + 8 + 16;
+unsigned const DECAL_INDEX_SIZE = 2;
+
+// DecalSets use 16-bit indices
+unsigned const DECALSET_MAX_VERTICES = 65535;
+unsigned const DECALSET_MAX_INDICES = DECALSET_MAX_VERTICES * 3;
+
+// If more decals than this are waiting, the oldest ones are dropped
+unsigned const MAX_QUEUED_DECALS = 1024;
+
+DecalManager::DecalSetInfo::DecalSetInfo() :
+    oldest(nullptr),
+    newest(nullptr)
+{
+}
+
+DecalManager::DecalManager() :
+    max_decals(0),
+    max_bytes(0),
+    draw_distance(0),
+    max_target_triangles(0),
+    decals_count(0),
+    used_bytes(0)
+{
+}
+
+void DecalManager::setBudget(unsigned max_decals, unsigned max_bytes)
+{
+    this->max_decals = max_decals;
+    this->max_bytes = max_bytes;
+}
+
+void DecalManager::setDrawDistance(float draw_distance)
+{
+    this->draw_distance = draw_distance;
+    for (DecalSets::Iterator i = decalsets.Begin(); i != decalsets.End(); ++ i) {
+        Urho3D::DecalSet* decalset = i->second_.decalset;
+        if (decalset) {
+            decalset->SetDrawDistance(draw_distance);
+        }
+    }
+}
+
+void DecalManager::setMaxTargetTriangles(unsigned max_target_triangles)
+{
+    this->max_target_triangles = max_target_triangles;
+}
+
+bool DecalManager::addDecal(Urho3D::DecalSet* decalset, Urho3D::Drawable* target, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end)
+{
+    if (max_target_triangles && countTriangles(target) > max_target_triangles) {
+        return false;
+    }
+
+    // If DecalSet is new, or an old one was destroyed and
+    // a new one got the same address, then start over.
+    DecalSetInfo& info = decalsets[decalset];
+    if (info.decalset.Expired()) {
+        while (info.oldest) {
+            forgetOldestDecal(info);
+        }
+        info.decalset = decalset;
+    }
+
+    reserveSpace(decalset);
+
+    unsigned decals_before = decalset->GetNumDecals();
+    unsigned bytes_before = calculateBytes(decalset->GetNumVertices(), decalset->GetNumIndices());
+    bool success = decalset->AddDecal(target, pos, rot, size, aspect, depth, uv_begin, uv_end);
+    unsigned decals_after = decalset->GetNumDecals();
+    unsigned bytes_after = calculateBytes(decalset->GetNumVertices(), decalset->GetNumIndices());
+
+    // Decal might be clipped away completely, even on success
+    bool added = success && (decals_after > decals_before || bytes_after != bytes_before);
+
+    // If DecalSet still had to remove its own oldest decals,
+    // then forget them and count their memory as freed.
+    unsigned removed_by_decalset = decals_before + (added ? 1 : 0) - decals_after;
+    unsigned bytes_removed_by_decalset = 0;
+    for (unsigned i = 0; i < removed_by_decalset && info.oldest; ++ i) {
+        bytes_removed_by_decalset += info.oldest->bytes;
+        forgetOldestDecal(info);
+    }
+
+    if (added) {
+        Decal decal;
+        decal.decalset = decalset;
+        decal.bytes = bytes_after + bytes_removed_by_decalset - bytes_before;
+        decal.removed = false;
+        decal.next_in_set = nullptr;
+        decals.Push(decal);
+        Decal* new_decal = &decals.Back();
+
+        if (info.newest) {
+            info.newest->next_in_set = new_decal;
+        } else {
+            info.oldest = new_decal;
+        }
+        info.newest = new_decal;
+
+        ++ decals_count;
+        used_bytes += decal.bytes;
+    }
+
+    // Keep within budget
+    while ((max_decals && decals_count > max_decals) || (max_bytes && used_bytes > max_bytes)) {
+        removeOldestDecal();
+    }
+    popRemovedDecals();
+
+    return success;
+}
+
+void DecalManager::queueDecal(Urho3D::Drawable* target, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end)
+{
+    // Dropped already here, so queue is not filled with them
+    if (max_target_triangles && countTriangles(target) > max_target_triangles) {
+        return;
+    }
+
+    Urho3D::Node* node = target->GetNode();
+    QueuedDecal queued;
+    queued.target = target;
+    queued.mat = mat;
+    queued.local_pos = node->WorldToLocal(pos);
+    queued.local_rot = node->GetWorldRotation().Inverse() * rot;
+    queued.size = size;
+    queued.aspect = aspect;
+    queued.depth = depth;
+    queued.uv_begin = uv_begin;
+    queued.uv_end = uv_end;
+    queue.Push(queued);
+
+    if (queue.Size() > MAX_QUEUED_DECALS) {
+        queue.PopFront();
+    }
+}
+
+void DecalManager::addQueuedDecals(float time_budget)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    while (!queue.Empty()) {
+        QueuedDecal const& queued = queue.Front();
+        Urho3D::Drawable* target = queued.target;
+        if (target && target->GetScene()) {
+            Urho3D::Node* node = target->GetNode();
+            Urho3D::DecalSet* decalset = getOrCreateDecalSet(node, queued.mat);
+            if (decalset) {
+                Urho3D::Vector3 pos = node->LocalToWorld(queued.local_pos);
+                Urho3D::Quaternion rot = node->GetWorldRotation() * queued.local_rot;
+                addDecal(decalset, target, pos, rot, queued.size, queued.aspect, queued.depth, queued.uv_begin, queued.uv_end);
+            }
+        }
+        queue.PopFront();
+
+        if (std::chrono::duration<float>(std::chrono::steady_clock::now() - begin).count() >= time_budget) {
+            break;
+        }
+    }
+}
+
+unsigned DecalManager::getNumQueuedDecals() const
+{
+    return queue.Size();
+}
+
+void DecalManager::removeDestroyedDecalSets()
+{
+    DecalSets::Iterator i = decalsets.Begin();
+    while (i != decalsets.End()) {
+        if (i->second_.decalset.Expired()) {
+            while (i->second_.oldest) {
+                forgetOldestDecal(i->second_);
+            }
+            i = decalsets.Erase(i);
+        } else {
+            ++ i;
+        }
+    }
+    popRemovedDecals();
+}
+
+unsigned DecalManager::getNumDecals() const
+{
+    return decals_count;
+}
+
+unsigned DecalManager::getNumDecalSets() const
+{
+    return decalsets.Size();
+}
+
+unsigned DecalManager::getUsedBytes() const
+{
+    return used_bytes;
+}
+
+unsigned DecalManager::getAllocatedBytes() const
+{
+    unsigned bytes = 0;
+    for (DecalSets::ConstIterator i = decalsets.Begin(); i != decalsets.End(); ++ i) {
+        Urho3D::DecalSet* decalset = i->second_.decalset;
+        if (decalset) {
+            bytes += calculateBytes(decalset->GetMaxVertices(), decalset->GetMaxIndices());
+        }
+    }
+    return bytes;
+}
+
+void DecalManager::removeOldestDecal()
+{
+    popRemovedDecals();
+    if (decals.Empty()) {
+        return;
+    }
+
+    // Oldest decal in the whole manager is also
+    // the oldest decal of its own DecalSet.
+    Urho3D::DecalSet* key = decals.Front().decalset;
+    DecalSets::Iterator decalsets_find = decalsets.Find(key);
+    assert(decalsets_find != decalsets.End());
+    DecalSetInfo& info = decalsets_find->second_;
+    assert(info.oldest == &decals.Front());
+    forgetOldestDecal(info);
+
+    Urho3D::DecalSet* decalset = info.decalset;
+    if (decalset) {
+        decalset->RemoveDecals(1);
+        // Do not leave empty DecalSets around
+        if (!decalset->GetNumDecals()) {
+            decalset->Remove();
+        }
+    }
+    if (!info.oldest) {
+        decalsets.Erase(decalsets_find);
+    }
+
+    decals.PopFront();
+}
+
+void DecalManager::forgetOldestDecal(DecalSetInfo& info)
+{
+    Decal* decal = info.oldest;
+    assert(decal && !decal->removed);
+    decal->removed = true;
+    -- decals_count;
+    used_bytes -= decal->bytes;
+
+    info.oldest = decal->next_in_set;
+    if (!info.oldest) {
+        info.newest = nullptr;
+    }
+}
+
+void DecalManager::popRemovedDecals()
+{
+    while (!decals.Empty() && decals.Front().removed) {
+        decals.PopFront();
+    }
+}
+
+Urho3D::DecalSet* DecalManager::getOrCreateDecalSet(Urho3D::Node* node, Urho3D::Material* mat)
+{
+    // Every Material needs its own DecalSet. Decal atlases
+    // can be used to put different decals to the same one.
+    Urho3D::PODVector<Urho3D::DecalSet*> node_decalsets;
+    node->GetComponents<Urho3D::DecalSet>(node_decalsets);
+    for (Urho3D::DecalSet* decalset : node_decalsets) {
+        if (decalset->GetMaterial() == mat) {
+            return decalset;
+        }
+    }
+    Urho3D::DecalSet* decalset = node->CreateComponent<Urho3D::DecalSet>();
+    decalset->SetMaterial(mat);
+    decalset->SetDrawDistance(draw_distance);
+    return decalset;
+}
+
+void DecalManager::reserveSpace(Urho3D::DecalSet* decalset)
+{
+    unsigned max_vertices = decalset->GetMaxVertices();
+    if (decalset->GetNumVertices() * 2 > max_vertices && max_vertices < DECALSET_MAX_VERTICES) {
+        decalset->SetMaxVertices(Urho3D::Min(max_vertices * 2, DECALSET_MAX_VERTICES));
+    }
+    unsigned max_indices = decalset->GetMaxIndices();
+    if (decalset->GetNumIndices() * 2 > max_indices && max_indices < DECALSET_MAX_INDICES) {
+        decalset->SetMaxIndices(Urho3D::Min(max_indices * 2, DECALSET_MAX_INDICES));
+    }
+}
+
+unsigned DecalManager::calculateBytes(unsigned vertices, unsigned indices)
+{
+    return vertices * DECAL_VERTEX_SIZE + indices * DECAL_INDEX_SIZE;
+}
+
+unsigned DecalManager::countTriangles(Urho3D::Drawable* drawable)
+{
+    unsigned triangles = 0;
+    for (unsigned i = 0; i < drawable->GetBatches().Size(); ++ i) {
+        Urho3D::Geometry* geometry = drawable->GetLodGeometry(i, 0);
+        if (geometry) {
+            triangles += (geometry->GetIndexCount() ? geometry->GetIndexCount() : geometry->GetVertexCount()) / 3;
+        }
+    }
+    return triangles;
+}
+
+}
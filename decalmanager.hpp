@@ -0,0 +1,138 @@
+#ifndef GAMELIB_DECALMANAGER_HPP
+#define GAMELIB_DECALMANAGER_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/List.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Graphics/DecalSet.h>
+#include <Urho3D/Graphics/Material.h>
+
+namespace GameLib
+{
+
+// Keeps track of decals of all DecalSets in the order they were added, so
+// when there are too many decals or they take too much memory, the oldest
+// ones are removed first, no matter which DecalSet they are in. Removing a
+// decal is constant time. DecalSets are grown when they get full, so they do
+// not need to remove their own decals. Memory use of decals is estimated
+// from vertex and index counts, assuming non-skinned geometry.
+//
+// Clipping decal geometry can be slow on complex meshes, so decals can also
+// be queued and added a few at a time, within a time budget per frame. Even
+// one decal goes through every triangle of its target, so decals on targets
+// that have too many triangles are dropped instead.
+class DecalManager
+{
+
+public:
+
+    DecalManager();
+
+    // Zero means no limit
+    void setBudget(unsigned max_decals, unsigned max_bytes);
+
+    // Sets draw distance of all DecalSets. Zero means infinite.
+    void setDrawDistance(float draw_distance);
+
+    // Decals are not added to targets that have more triangles than
+    // this in their most detailed geometry. Zero means no limit.
+    void setMaxTargetTriangles(unsigned max_target_triangles);
+
+    // Adds decal to DecalSet, and then removes the oldest
+    // decals until budget is met. Returns false on failure.
+    bool addDecal(Urho3D::DecalSet* decalset, Urho3D::Drawable* target, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
+
+    // Queues decal to be added later to target. DecalSet that uses the given
+    // Material is created to the Node of target if needed. If target is
+    // destroyed or removed from Scene before that, the decal is dropped.
+    // Position and rotation are kept relative to the Node of target, so
+    // the decal ends up in the right place even if the Node moves.
+    void queueDecal(Urho3D::Drawable* target, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
+
+    // Adds queued decals until given amount of seconds has been spent.
+    // At least one decal is added, so the queue always progresses.
+    void addQueuedDecals(float time_budget);
+
+    unsigned getNumQueuedDecals() const;
+
+    // Forgets decals of DecalSets that have been destroyed,
+    // for example with their Nodes. Called by GameState.
+    void removeDestroyedDecalSets();
+
+    unsigned getNumDecals() const;
+    unsigned getNumDecalSets() const;
+    // Bytes of vertices and indices that decals use
+    unsigned getUsedBytes() const;
+    // Bytes of vertex and index buffers of DecalSets, including unused space
+    unsigned getAllocatedBytes() const;
+
+private:
+
+    struct Decal
+    {
+        Urho3D::DecalSet* decalset;
+        unsigned bytes;
+        // Decal was removed by other means than budget
+        bool removed;
+        // Next newer decal in the same DecalSet
+        Decal* next_in_set;
+    };
+
+    struct DecalSetInfo
+    {
+        DecalSetInfo();
+
+        Urho3D::WeakPtr<Urho3D::DecalSet> decalset;
+        Decal* oldest;
+        Decal* newest;
+    };
+
+    struct QueuedDecal
+    {
+        Urho3D::WeakPtr<Urho3D::Drawable> target;
+        Urho3D::SharedPtr<Urho3D::Material> mat;
+        // In the space of the Node of target
+        Urho3D::Vector3 local_pos;
+        Urho3D::Quaternion local_rot;
+        float size;
+        float aspect;
+        float depth;
+        Urho3D::Vector2 uv_begin;
+        Urho3D::Vector2 uv_end;
+    };
+
+    typedef Urho3D::List<Decal> Decals;
+    typedef Urho3D::List<QueuedDecal> QueuedDecals;
+    typedef Urho3D::HashMap<Urho3D::DecalSet*, DecalSetInfo> DecalSets;
+
+    unsigned max_decals;
+    unsigned max_bytes;
+    float draw_distance;
+    unsigned max_target_triangles;
+
+    // From oldest to newest
+    Decals decals;
+    DecalSets decalsets;
+
+    unsigned decals_count;
+    unsigned used_bytes;
+
+    QueuedDecals queue;
+
+    void removeOldestDecal();
+    // Forgets oldest decal of DecalSet, but does not remove it from DecalSet
+    void forgetOldestDecal(DecalSetInfo& info);
+    void popRemovedDecals();
+
+    Urho3D::DecalSet* getOrCreateDecalSet(Urho3D::Node* node, Urho3D::Material* mat);
+
+    // Grows buffers of DecalSet if they are more than half full
+    static void reserveSpace(Urho3D::DecalSet* decalset);
+    static unsigned calculateBytes(unsigned vertices, unsigned indices);
+    // Triangles of the most detailed geometry of Drawable
+    static unsigned countTriangles(Urho3D::Drawable* drawable);
+};
+
+}
+
+#endif
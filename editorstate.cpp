@@ -28,7 +28,7 @@ EditorState::EditorState(App* app, Urho3D::Context* context, Urho3D::String cons
 {
     // Camera and listener
     cam_control.setPitch(45);
-    Urho3D::Node* camera_node = app->getScene()->CreateChild("camera", Urho3D::LOCAL);
+    Urho3D::Node* camera_node = createCameraNode();
     camera_node->SetPosition(Urho3D::Vector3(0, 10, 0));
     camera_node->SetRotation(cam_control.getRotation());
     Urho3D::Camera* camera = camera_node->CreateComponent<Urho3D::Camera>();
@@ -73,10 +73,7 @@ void EditorState::show()
 void EditorState::hide()
 {
     // Remove possible brush gameobject
-    Urho3D::Node* brush_node = getApp()->getScene()->GetChild("brush");
-    if (brush_node) {
-        brush_node->Remove();
-    }
+    removeBrush();
 
     // Write scene to disk
     writeSceneToDisk(getApp()->getScene(), path);
@@ -127,7 +124,6 @@ void EditorState::handleMouseButtonDown(Urho3D::StringHash event_type, Urho3D::V
     if (button == Urho3D::MOUSEB_LEFT) {
         if (mode == MODE_DEFAULT) {
             if (brush_selection >= 0) {
-                Urho3D::Node* brush_node = getApp()->getScene()->GetChild("brush");
                 Urho3D::Node* node = getApp()->getScene()->CreateChild();
                 node->SetTransform(brush_node->GetTransform());
                 Urho3D::Component* obj_raw = node->CreateComponent(editable_object_types[brush_selection]);
@@ -165,10 +161,7 @@ void EditorState::handleMouseWheel(Urho3D::StringHash event_type, Urho3D::Varian
     while (brush_selection >= int(editable_object_types.Size())) {
         brush_selection -= editable_object_types.Size() + 1;
     }
-    Urho3D::Node* brush_node = getApp()->getScene()->GetChild("brush");
-    if (brush_node) {
-        brush_node->Remove();
-    }
+    removeBrush();
 }
 
 void EditorState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
@@ -181,7 +174,7 @@ void EditorState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap
 
     // Update camera transform
     cam_control.update(mode == MODE_ROTATING_VIEW);
-    Urho3D::Node* cam_node = getApp()->getScene()->GetChild("camera");
+    Urho3D::Node* cam_node = getCameraNode();
     cam_node->SetRotation(cam_control.getRotation());
     cam_node->SetPosition(cam_node->GetPosition() + cam_control.getFlyingMovement() * deltatime * MOVEMENT_SPEED);
 
@@ -193,38 +186,26 @@ void EditorState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap
     // Update brush "cursor"
     Urho3D::Vector3 brush_pos;
     Urho3D::Vector3 brush_normal;
-    Urho3D::Node* brush_node = getApp()->getScene()->GetChild("brush");
     bool brush_visible = raycast(brush_pos, brush_normal);
     if (brush_visible && brush_selection >= 0 && (mode == MODE_DEFAULT || mode == MODE_ROTATING_OBJECT)) {
-        GameObject* obj = NULL;
         if (!brush_node) {
             brush_node = getApp()->getScene()->CreateChild("brush");
             Urho3D::Component* obj_raw = brush_node->CreateComponent(editable_object_types[brush_selection]);
-            obj = dynamic_cast<GameObject*>(obj_raw);
-            obj->finishCreation(getApp(), false);
-        } else {
-            for (unsigned i = 0; i < brush_node->GetNumComponents(); ++ i) {
-                Urho3D::Component* component = brush_node->GetComponents()[i];
-                obj = dynamic_cast<GameObject*>(component);
-                if (obj) {
-                    break;
-                }
-            }
-            assert(obj);
+            brush_obj = dynamic_cast<GameObject*>(obj_raw);
+            brush_obj->finishCreation(getApp(), false);
         }
-        if (obj) {
+        assert(brush_obj);
+        if (brush_obj) {
             float final_brush_yaw = brush_yaw;
             if (input->GetKeyDown(Urho3D::KEY_G)) {
                 brush_pos = getApp()->snapPosition(brush_pos);
                 final_brush_yaw = getApp()->snapAngle(brush_yaw);
             }
-            brush_node->SetPosition(calculateObjectPlacementPosition(brush_pos, brush_normal, obj));
+            brush_node->SetPosition(calculateObjectPlacementPosition(brush_pos, brush_normal, brush_obj));
             brush_node->SetRotation(Urho3D::Quaternion(final_brush_yaw, Urho3D::Vector3::UP));
         }
     } else {
-        if (brush_node) {
-            brush_node->Remove();
-        }
+        removeBrush();
     }
 
 }
@@ -234,8 +215,7 @@ bool EditorState::raycast(Urho3D::Vector3& result_pos, Urho3D::Vector3& result_n
     Urho3D::Graphics* graphics = GetSubsystem<Urho3D::Graphics>();
     Urho3D::Input* input = GetSubsystem<Urho3D::Input>();
 
-    Urho3D::Node* camera_node = getApp()->getScene()->GetChild("camera");
-    Urho3D::Camera* camera = camera_node->GetComponent<Urho3D::Camera>();
+    Urho3D::Camera* camera = getCameraNode()->GetComponent<Urho3D::Camera>();
     static Urho3D::IntVector2 mouse_pos;
     if (mode == MODE_DEFAULT) {
         mouse_pos = input->GetMousePosition();
@@ -246,7 +226,6 @@ bool EditorState::raycast(Urho3D::Vector3& result_pos, Urho3D::Vector3& result_n
     getApp()->getScene()->GetComponent<Urho3D::Octree>()->Raycast(raycast_query);
 
     // If there was a hit to some object
-    Urho3D::Node* brush_node = getApp()->getScene()->GetChild("brush");
     for (unsigned i = 0; i < raycast_results.Size(); ++ i) {
         Urho3D::RayQueryResult raycast_result = raycast_results[i];
         // Skip brush object
@@ -285,4 +264,13 @@ Urho3D::Vector3 EditorState::calculateObjectPlacementPosition(Urho3D::Vector3 co
     return pos + shape.positionAtNormal(normal);
 }
 
+void EditorState::removeBrush()
+{
+    if (brush_node) {
+        brush_node->Remove();
+        brush_node.Reset();
+        brush_obj.Reset();
+    }
+}
+
 }
@@ -43,6 +43,8 @@ private:
     // Brush
     int brush_selection;
     float brush_yaw;
+    Urho3D::WeakPtr<Urho3D::Node> brush_node;
+    Urho3D::WeakPtr<GameObject> brush_obj;
 
     void handleKeyDown(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleKeyUp(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
@@ -54,6 +56,8 @@ private:
     bool raycast(Urho3D::Vector3& result_pos, Urho3D::Vector3& result_normal);
 
     Urho3D::Vector3 calculateObjectPlacementPosition(Urho3D::Vector3 const& pos, Urho3D::Vector3 const& normal, GameLib::GameObject const* obj);
+
+    void removeBrush();
 };
 
 }
@@ -1,20 +1,134 @@
 #include "gameobject.hpp"
 
+#include "app.hpp"
+#include "gameobjectregistry.hpp"
+#include "tickprofiler.hpp"
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Drawable.h>
 #include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Network/NetworkPriority.h>
 #include <Urho3D/Scene/Scene.h>
 
 namespace GameLib
 {
 
+// Rays that are close to each other share one octree query. If there
+// are more clusters than this, then rays join the closest one.
+unsigned const MAX_HITSCAN_CLUSTERS = 16;
+
+struct HitscanCluster
+{
+    Urho3D::BoundingBox bounds;
+    Urho3D::PODVector<Urho3D::Drawable*> candidates;
+};
+
+// Ray of batched hitscan and the geometry it hit, sorted by distance
+struct HitscanJob
+{
+    HitscanRay const* ray;
+    Urho3D::PODVector<Urho3D::Drawable*> const* candidates;
+    Urho3D::PODVector<Urho3D::RayQueryResult> hits;
+};
+
+// Hit that is waiting for handleHitscan(). Node is weak, because
+// handling earlier hits might have destroyed it.
+struct HitscanHit
+{
+    Urho3D::WeakPtr<Urho3D::Node> node;
+    Urho3D::Vector3 pos;
+    float distance;
+};
+
+// Size of box that is cheap to calculate and does not
+// become zero for flat boxes, like those of straight rays.
+static float getBoxSize(Urho3D::BoundingBox const& box)
+{
+    Urho3D::Vector3 size = box.Size();
+    return size.x_ + size.y_ + size.z_;
+}
+
+// Higher is more permissive
+static unsigned getRelevanceOrder(GameObject::Relevance relevance)
+{
+    if (relevance == GameObject::RELEVANCE_OWNER_ONLY) {
+        return 0;
+    }
+    if (relevance == GameObject::RELEVANCE_DISTANCE) {
+        return 1;
+    }
+    return 2;
+}
+
+static bool compareRayQueryResults(Urho3D::RayQueryResult const& a, Urho3D::RayQueryResult const& b)
+{
+    return a.distance_ < b.distance_;
+}
+
+static bool compareHitscanHits(HitscanHit const& a, HitscanHit const& b)
+{
+    return a.distance < b.distance;
+}
+
+// Tests ray against drawables found by the shared octree query. This
+// only reads the scene, so it can be run in worker threads.
+static void runHitscanJob(HitscanJob& job)
+{
+    HitscanRay const& ray = *job.ray;
+    Urho3D::RayOctreeQuery query(job.hits, ray.ray, Urho3D::RAY_TRIANGLE, ray.max_distance, Urho3D::DRAWABLE_GEOMETRY);
+    for (Urho3D::Drawable* drawable : *job.candidates) {
+        if (ray.ray.HitDistance(drawable->GetWorldBoundingBox()) < ray.max_distance) {
+            drawable->ProcessRayQuery(query, job.hits);
+        }
+    }
+    Urho3D::Sort(job.hits.Begin(), job.hits.End(), compareRayQueryResults);
+}
+
+static void runHitscanJobs(Urho3D::WorkItem const* item, unsigned thread_index)
+{
+    (void)thread_index;
+    HitscanJob* job = static_cast<HitscanJob*>(item->start_);
+    HitscanJob* end = static_cast<HitscanJob*>(item->end_);
+    while (job != end) {
+        if (job->ray->max_distance < Urho3D::M_INFINITY) {
+            runHitscanJob(*job);
+        }
+        ++ job;
+    }
+}
+
 GameObject::GameObject(Urho3D::Context* context) :
     Urho3D::Component(context),
     app(nullptr),
-    handles_physics_collisions(false)
+    handles_physics_collisions(false),
+    runs_in_parallel(false),
+    lag_compensated(false),
+    always_runs_on_client(false),
+    relevance(RELEVANCE_DISTANCE),
+    node_relevance(RELEVANCE_DISTANCE),
+    added_to_client(false),
+    client_deltatime_accumulator(0),
+    hit_history_slot(HitHistory::NO_SLOT),
+    spatial_item(SpatialGrid::NO_ITEM),
+    moves(0),
+    sleeping(false),
+    sleep_timer(0),
+    pending_sleep_duration(Urho3D::M_INFINITY)
 {
+    for (unsigned i = 0; i < GameObjectRegistry::LIST_TYPES_COUNT; ++ i) {
+        registry_indices[i] = Urho3D::M_MAX_UNSIGNED;
+    }
 }
 
 GameObject::~GameObject()
 {
+    if (registry) {
+        registry->remove(this);
+    }
 }
 
 void GameObject::setHandlesPhysicsCollisions(bool handles_physics_collisions)
@@ -27,14 +141,189 @@ bool GameObject::getHandlesPhysicsCollisions() const
     return handles_physics_collisions;
 }
 
+void GameObject::setRunsInParallel(bool runs_in_parallel)
+{
+    this->runs_in_parallel = runs_in_parallel;
+}
+
+bool GameObject::getRunsInParallel() const
+{
+    return runs_in_parallel;
+}
+
+void GameObject::setAlwaysRunsOnClient(bool always_runs_on_client)
+{
+    this->always_runs_on_client = always_runs_on_client;
+}
+
+bool GameObject::getAlwaysRunsOnClient() const
+{
+    return always_runs_on_client;
+}
+
+void GameObject::setRelevance(Relevance relevance)
+{
+    this->relevance = relevance;
+    updateNodeRelevance(nullptr);
+}
+
+GameObject::Relevance GameObject::getRelevance() const
+{
+    return relevance;
+}
+
+GameObject::Relevance GameObject::getNodeRelevance(Urho3D::Node* node)
+{
+    for (Urho3D::Component* comp : node->GetComponents()) {
+        if (comp->IsInstanceOf<GameObject>()) {
+            return static_cast<GameObject*>(comp)->node_relevance;
+        }
+    }
+    // Nodes without GameObjects do not get NetworkPriority
+    return RELEVANCE_ALWAYS;
+}
+
+GameObject::Relevance GameObject::getNodeRelevance() const
+{
+    return node_relevance;
+}
+
+bool GameObject::isRelevantTo(Urho3D::Connection* conn, float margin) const
+{
+    // Without App, NetworkPriority is not set up
+    Urho3D::Node* node = GetNode();
+    if (!node || !app || node->GetOwner() == conn) {
+        return true;
+    }
+    if (node_relevance == RELEVANCE_ALWAYS) {
+        return true;
+    }
+    if (node_relevance == RELEVANCE_OWNER_ONLY) {
+        return false;
+    }
+    // Priority reaches zero at the end of hysteresis
+    float max_distance = app->getRelevanceDistance() + Urho3D::Max(app->getRelevanceHysteresis(), 0.001f) - margin;
+    return (node->GetWorldPosition() - conn->GetPosition()).Length() < max_distance;
+}
+
+unsigned GameObject::popMoveCount()
+{
+    unsigned result = moves;
+    moves = 0;
+    return result;
+}
+
+void GameObject::sleep()
+{
+    sleep(Urho3D::M_INFINITY);
+}
+
+void GameObject::sleep(float duration)
+{
+    if (registry) {
+        registry->sleep(this, duration);
+    } else {
+        // Timer is started when joining a registry
+        sleeping = true;
+        pending_sleep_duration = duration;
+    }
+}
+
+void GameObject::wake()
+{
+    if (registry) {
+        registry->wake(this);
+    } else {
+        sleeping = false;
+        pending_sleep_duration = Urho3D::M_INFINITY;
+    }
+}
+
+bool GameObject::isSleeping() const
+{
+    return sleeping;
+}
+
+void GameObject::setLagCompensated(bool lag_compensated)
+{
+    if (registry) {
+        registry->setLagCompensated(this, lag_compensated);
+    } else {
+        this->lag_compensated = lag_compensated;
+    }
+}
+
+bool GameObject::getLagCompensated() const
+{
+    return lag_compensated;
+}
+
+float GameObject::getLagCompensationRewind() const
+{
+    Urho3D::Connection* conn = GetNode() ? GetNode()->GetOwner() : nullptr;
+    if (!conn) {
+        return 0;
+    }
+    float rewind = conn->GetRoundTripTime() / 1000.0f;
+    if (registry) {
+        rewind += registry->getLagCompensation().getInterpolationDelay(conn);
+    }
+    return rewind;
+}
+
+TimerWheel::TimerId GameObject::scheduleTimer(float delay, TimerWheel::Callback const& callback)
+{
+    if (!registry) {
+        URHO3D_LOGERRORF("Unable to schedule timer for %s, because it is not in a Scene!", GetTypeName().CString());
+        return 0;
+    }
+    Urho3D::WeakPtr<GameObject> self(this);
+    return registry->getTimers().schedule(uint64_t(delay * 1000), [self, callback]() {
+        if (self && self->registry) {
+            callback();
+        }
+    });
+}
+
+void GameObject::cancelTimer(TimerWheel::TimerId id)
+{
+    if (registry) {
+        registry->getTimers().cancel(id);
+    }
+}
+
 void GameObject::setApp(App* app)
 {
     this->app = app;
 }
 
+bool GameObject::isAddedToClient() const
+{
+    return added_to_client;
+}
+
+void GameObject::setAddedToClient()
+{
+    added_to_client = true;
+}
+
+float GameObject::addClientDeltatime(float deltatime)
+{
+    client_deltatime_accumulator += deltatime;
+    return client_deltatime_accumulator;
+}
+
+float GameObject::popClientDeltatime()
+{
+    float result = client_deltatime_accumulator;
+    client_deltatime_accumulator = 0;
+    return result;
+}
+
 void GameObject::finishCreation(App* app, bool enable_physics, Urho3D::VariantMap* data)
 {
     this->app = app;
+    updateNetworkPriority();
     handleCreated(enable_physics, data);
 }
 
@@ -51,6 +340,17 @@ bool GameObject::runClientSide(float deltatime)
     return true;
 }
 
+bool GameObject::supportsPrediction() const
+{
+    return false;
+}
+
+void GameObject::runPrediction(float deltatime, Urho3D::Controls const& controls)
+{
+    (void)deltatime;
+    (void)controls;
+}
+
 void GameObject::handleCreated(bool enable_physics, Urho3D::VariantMap* data)
 {
     (void)enable_physics;
@@ -73,6 +373,16 @@ void GameObject::handleExplosion(Urho3D::Vector3 const& pos)
     (void)pos;
 }
 
+void GameObject::handlePhysicsCollisions(PhysicsContact const* contacts, unsigned contacts_count, Urho3D::Node* node, GameObject* obj)
+{
+    // Stop if the GameObject gets destroyed by one of the callbacks
+    Urho3D::WeakPtr<GameObject> self(this);
+    for (unsigned i = 0; i < contacts_count && self; ++ i) {
+        PhysicsContact const& contact = contacts[i];
+        handlePhysicsCollision(contact.pos, contact.normal, contact.distance, node, obj);
+    }
+}
+
 void GameObject::handlePhysicsCollision(Urho3D::Vector3 const& pos, Urho3D::Vector3 const& normal, float distance, Urho3D::Node* node, GameObject* obj)
 {
     (void)pos;
@@ -103,47 +413,241 @@ Shape GameObject::getPlacementShape() const
     return Shape();
 }
 
-bool GameObject::hitscan(Urho3D::Vector3& result_hitpos, Urho3D::Ray const& ray)
+bool GameObject::hitscan(Urho3D::Vector3& result_hitpos, Urho3D::Ray const& ray, float rewind)
+{
+    Urho3D::PODVector<HitscanRay> rays(1);
+    rays[0].ray = ray;
+    rays[0].max_distance = Urho3D::M_INFINITY;
+    Urho3D::Vector<HitscanResult> results;
+    hitscan(results, rays, false, rewind);
+    if (results[0].gameobj) {
+        result_hitpos = results[0].pos;
+        return true;
+    }
+    return false;
+}
+
+void GameObject::hitscan(Urho3D::Vector<HitscanResult>& results, Urho3D::PODVector<HitscanRay> const& rays, bool use_worker_threads, float rewind)
 {
-    // Do ray query
-    Urho3D::PODVector<Urho3D::RayQueryResult> ray_hits;
-    Urho3D::RayOctreeQuery query(ray_hits, ray, Urho3D::RAY_TRIANGLE, Urho3D::M_INFINITY, Urho3D::DRAWABLE_GEOMETRY);
+    assert(registry);
     Urho3D::Octree* octree = GetScene()->GetComponent<Urho3D::Octree>();
-	octree->Raycast(query);
-
-    // Iterate hit objects
-    for (unsigned i = 0; i < ray_hits.Size(); ++ i) {
-        Urho3D::RayQueryResult const& ray_hit = ray_hits[i];
-        Urho3D::Node* node = ray_hit.drawable_->GetNode();
-        while (node != GetScene()) {
-            for (unsigned j = 0; j < node->GetNumComponents(); ++ j) {
-                Urho3D::Component* component = node->GetComponents()[j];
-                GameLib::GameObject* gameobj = dynamic_cast<GameLib::GameObject*>(component);
-                if (gameobj && gameobj != this && gameobj->handleHitscan(ray_hit.position_, ray.direction_)) {
-                    result_hitpos = ray_hit.position_;
-                    return true;
+
+    // Group rays that have finite length into clusters of nearby rays. A ray
+    // joins a cluster only if the box of the cluster grows less than the
+    // box of the ray, so rays far apart do not make one huge query.
+    Urho3D::Vector<HitscanCluster> clusters;
+    Urho3D::PODVector<unsigned> ray_clusters(rays.Size());
+    for (unsigned i = 0; i < rays.Size(); ++ i) {
+        HitscanRay const& ray = rays[i];
+        ray_clusters[i] = Urho3D::M_MAX_UNSIGNED;
+        if (ray.max_distance >= Urho3D::M_INFINITY) {
+            continue;
+        }
+        Urho3D::BoundingBox ray_bounds(ray.ray.origin_, ray.ray.origin_);
+        ray_bounds.Merge(ray.ray.origin_ + ray.ray.direction_ * ray.max_distance);
+        float ray_size = getBoxSize(ray_bounds);
+
+        unsigned best_cluster = Urho3D::M_MAX_UNSIGNED;
+        float best_growth = Urho3D::M_INFINITY;
+        for (unsigned cluster_i = 0; cluster_i < clusters.Size(); ++ cluster_i) {
+            HitscanCluster const& cluster = clusters[cluster_i];
+            Urho3D::BoundingBox merged = cluster.bounds;
+            merged.Merge(ray_bounds);
+            float growth = getBoxSize(merged) - getBoxSize(cluster.bounds);
+            if (growth < best_growth && (growth <= ray_size || clusters.Size() >= MAX_HITSCAN_CLUSTERS)) {
+                best_cluster = cluster_i;
+                best_growth = growth;
+            }
+        }
+        if (best_cluster == Urho3D::M_MAX_UNSIGNED) {
+            best_cluster = clusters.Size();
+            clusters.Resize(clusters.Size() + 1);
+            clusters.Back().bounds = ray_bounds;
+        } else {
+            clusters[best_cluster].bounds.Merge(ray_bounds);
+        }
+        ray_clusters[i] = best_cluster;
+    }
+
+    // Find drawables near the rays of each cluster with one query
+    for (HitscanCluster& cluster : clusters) {
+        Urho3D::BoxOctreeQuery query(cluster.candidates, cluster.bounds, Urho3D::DRAWABLE_GEOMETRY);
+        octree->GetDrawables(query);
+    }
+
+    // Rays without limit cannot use the shared query, so do them separately
+    Urho3D::Vector<HitscanJob> jobs(rays.Size());
+    unsigned finite_rays = 0;
+    for (unsigned i = 0; i < rays.Size(); ++ i) {
+        HitscanJob& job = jobs[i];
+        job.ray = &rays[i];
+        job.candidates = nullptr;
+        if (job.ray->max_distance < Urho3D::M_INFINITY) {
+            job.candidates = &clusters[ray_clusters[i]].candidates;
+            ++ finite_rays;
+        } else {
+            Urho3D::RayOctreeQuery query(job.hits, job.ray->ray, Urho3D::RAY_TRIANGLE, Urho3D::M_INFINITY, Urho3D::DRAWABLE_GEOMETRY);
+            octree->Raycast(query);
+        }
+    }
+
+    // Test rays against geometry
+    Urho3D::WorkQueue* queue = GetSubsystem<Urho3D::WorkQueue>();
+    if (use_worker_threads && finite_rays > 1 && queue->GetNumThreads() > 0) {
+        unsigned items_count = Urho3D::Min(jobs.Size(), (queue->GetNumThreads() + 1) * 4);
+        unsigned jobs_per_item = (jobs.Size() + items_count - 1) / items_count;
+        for (unsigned begin = 0; begin < jobs.Size(); begin += jobs_per_item) {
+            unsigned end = Urho3D::Min(begin + jobs_per_item, jobs.Size());
+            Urho3D::SharedPtr<Urho3D::WorkItem> item = queue->GetFreeItem();
+            item->priority_ = Urho3D::M_MAX_UNSIGNED;
+            item->workFunction_ = runHitscanJobs;
+            item->start_ = &jobs[begin];
+            item->end_ = &jobs[0] + end;
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(Urho3D::M_MAX_UNSIGNED);
+    } else {
+        for (HitscanJob& job : jobs) {
+            if (job.ray->max_distance < Urho3D::M_INFINITY) {
+                runHitscanJob(job);
+            }
+        }
+    }
+
+    // If rewinding, then get past bounds of lag compensated GameObjects.
+    // Reading history does not touch the Scene.
+    GameObjectRegistry* registry = this->registry;
+    Urho3D::PODVector<Urho3D::Node*> past_nodes;
+    Urho3D::PODVector<Urho3D::BoundingBox> past_bounds;
+    if (rewind > 0) {
+        for (unsigned i = 0; i < registry->getNumLagCompensatedGameObjects(); ++ i) {
+            GameObject* gameobj = registry->getLagCompensatedGameObject(i);
+            Urho3D::BoundingBox bounds;
+            if (gameobj && gameobj != this && !past_nodes.Contains(gameobj->GetNode()) && registry->getLagCompensation().getPastBounds(bounds, gameobj, rewind)) {
+                past_nodes.Push(gameobj->GetNode());
+                past_bounds.Push(bounds);
+            }
+        }
+    }
+
+    // Collect hits before calling any GameObjects, because they might destroy
+    // Nodes, and then the Drawables in query results would not be valid anymore.
+    Urho3D::Vector<HitscanHit> hits;
+    Urho3D::PODVector<unsigned> hits_begins(jobs.Size() + 1);
+    for (unsigned i = 0; i < jobs.Size(); ++ i) {
+        hits_begins[i] = hits.Size();
+        for (Urho3D::RayQueryResult const& ray_hit : jobs[i].hits) {
+            // GameObjects that have past bounds are not hit at their current place
+            if (!past_nodes.Empty() && past_nodes.Contains(registry->findGameObjectNode(ray_hit.drawable_->GetNode()))) {
+                continue;
+            }
+            HitscanHit hit;
+            hit.node = ray_hit.drawable_->GetNode();
+            hit.pos = ray_hit.position_;
+            hit.distance = ray_hit.distance_;
+            hits.Push(hit);
+        }
+        if (!past_nodes.Empty()) {
+            HitscanRay const& ray = rays[i];
+            for (unsigned past_i = 0; past_i < past_nodes.Size(); ++ past_i) {
+                float distance = ray.ray.HitDistance(past_bounds[past_i]);
+                if (distance < ray.max_distance) {
+                    HitscanHit hit;
+                    hit.node = past_nodes[past_i];
+                    hit.pos = ray.ray.origin_ + ray.ray.direction_ * distance;
+                    hit.distance = distance;
+                    hits.Push(hit);
                 }
             }
-            node = node->GetParent();
+            Urho3D::Sort(hits.Begin() + hits_begins[i], hits.End(), compareHitscanHits);
         }
     }
+    hits_begins[jobs.Size()] = hits.Size();
 
-    return false;
+    // Let GameObjects handle the hits in the order of rays. For every hit, all
+    // GameObjects of Nodes are tried from the hit Node towards the root of the
+    // Scene. GameObjects might remove Nodes, so they are only referred weakly.
+    Urho3D::PODVector<GameObject*> node_gameobjs;
+    Urho3D::Vector<Urho3D::WeakPtr<GameObject> > weak_node_gameobjs;
+    results.Resize(rays.Size());
+    for (unsigned i = 0; i < rays.Size(); ++ i) {
+        HitscanResult& result = results[i];
+        result.gameobj.Reset();
+        result.pos = Urho3D::Vector3::ZERO;
+        result.distance = Urho3D::M_INFINITY;
+        for (unsigned hit_i = hits_begins[i]; hit_i < hits_begins[i + 1] && !result.gameobj; ++ hit_i) {
+            HitscanHit const& hit = hits[hit_i];
+            Urho3D::Node* node = registry->findGameObjectNode(hit.node);
+            while (node && !result.gameobj) {
+                Urho3D::WeakPtr<Urho3D::Node> parent(node->GetParent());
+                node->GetDerivedComponents<GameObject>(node_gameobjs);
+                weak_node_gameobjs.Clear();
+                for (GameObject* gameobj : node_gameobjs) {
+                    weak_node_gameobjs.Push(Urho3D::WeakPtr<GameObject>(gameobj));
+                }
+                for (Urho3D::WeakPtr<GameObject> const& gameobj : weak_node_gameobjs) {
+                    if (!gameobj || gameobj.Get() == this) {
+                        continue;
+                    }
+                    gameobj->wake();
+                    bool accepted;
+                    {
+                        TickProfiler::Scope profile(gameobj.Get(), TickProfiler::HANDLE_HITSCAN);
+                        accepted = gameobj->handleHitscan(hit.pos, rays[i].ray.direction_);
+                    }
+                    if (accepted) {
+                        result.gameobj = gameobj;
+                        result.pos = hit.pos;
+                        result.distance = hit.distance;
+                        break;
+                    }
+                }
+                node = parent ? registry->findGameObjectNode(parent) : nullptr;
+            }
+        }
+    }
 }
 
-void GameObject::explosion(Urho3D::Vector3 const& pos)
+void GameObject::explosion(Urho3D::Vector3 const& pos, float radius)
 {
-    // Iterate all objects in Scene
-    Urho3D::PODVector<Urho3D::Node*> nodes = GetScene()->GetChildren(false);
-    for (unsigned i = 0; i < nodes.Size(); ++ i) {
-        Urho3D::Node* node = nodes[i];
-        for (unsigned j = 0; j < node->GetNumComponents(); ++ j) {
-            Urho3D::Component* component = node->GetComponents()[j];
-            GameObject* gameobj = dynamic_cast<GameObject*>(component);
-            if (gameobj) {
+    // GameObjects outside Scene cannot reach others
+    if (!registry) {
+        return;
+    }
+
+    // If there is no range, then iterate all GameObjects in Scene
+    if (radius >= Urho3D::M_INFINITY) {
+        Urho3D::Scene* scene = GetScene();
+        registry->lockIteration();
+        unsigned gameobjs_count = registry->getNumGameObjects();
+        for (unsigned i = 0; i < gameobjs_count; ++ i) {
+            GameObject* gameobj = registry->getGameObject(i);
+            // Like ticks, only GameObjects of root Nodes are reached
+            if (gameobj && gameobj->GetNode()->GetParent() == scene) {
+                gameobj->wake();
+                TickProfiler::Scope profile(gameobj, TickProfiler::HANDLE_EXPLOSION);
                 gameobj->handleExplosion(pos);
             }
         }
+        registry->unlockIteration();
+        return;
+    }
+
+    // Only GameObjects in range. Handling the explosion
+    // might destroy other GameObjects in the results.
+    Urho3D::PODVector<GameObject*> found;
+    registry->findGameObjects(found, pos, radius);
+    Urho3D::Vector<Urho3D::WeakPtr<GameObject> > gameobjs;
+    gameobjs.Reserve(found.Size());
+    for (GameObject* gameobj : found) {
+        gameobjs.Push(Urho3D::WeakPtr<GameObject>(gameobj));
+    }
+    for (Urho3D::WeakPtr<GameObject> const& gameobj : gameobjs) {
+        if (gameobj) {
+            gameobj->wake();
+            TickProfiler::Scope profile(gameobj.Get(), TickProfiler::HANDLE_EXPLOSION);
+            gameobj->handleExplosion(pos);
+        }
     }
 }
 
@@ -152,4 +656,129 @@ App* GameObject::getApp() const
     return app;
 }
 
+void GameObject::updateNodeRelevance(GameObject const* leaving)
+{
+    Urho3D::Node* node = GetNode();
+
+    Relevance result = RELEVANCE_OWNER_ONLY;
+    bool found = false;
+    for (Urho3D::Component* comp : node->GetComponents()) {
+        if (comp == leaving || !comp->IsInstanceOf<GameObject>()) {
+            continue;
+        }
+        Relevance comp_relevance = static_cast<GameObject*>(comp)->relevance;
+        if (getRelevanceOrder(comp_relevance) >= getRelevanceOrder(result)) {
+            result = comp_relevance;
+        }
+        found = true;
+    }
+    // Nodes without GameObjects do not get NetworkPriority
+    if (!found) {
+        result = RELEVANCE_ALWAYS;
+    }
+
+    for (Urho3D::Component* comp : node->GetComponents()) {
+        if (comp == leaving || !comp->IsInstanceOf<GameObject>()) {
+            continue;
+        }
+        GameObject* gameobj = static_cast<GameObject*>(comp);
+        if (gameobj->node_relevance != result) {
+            gameobj->node_relevance = result;
+            if (gameobj->registry) {
+                gameobj->registry->markRelevanceChanged(gameobj);
+            }
+        }
+    }
+
+    // All GameObjects of the Node set up the same NetworkPriority. Components
+    // of the Node must not be changed while one of them is being removed.
+    if (!leaving) {
+        updateNetworkPriority();
+    }
+}
+
+void GameObject::updateNetworkPriority()
+{
+    Urho3D::Node* node = GetNode();
+    if (!app || !node || GetSubsystem<Urho3D::Network>()->GetServerConnection()) {
+        return;
+    }
+
+    // Other GameObjects of the Node might need more updates,
+    // so this uses the relevance of the whole Node.
+    Urho3D::NetworkPriority* priority = node->GetComponent<Urho3D::NetworkPriority>();
+    if (node_relevance == RELEVANCE_ALWAYS) {
+        if (priority) {
+            priority->Remove();
+        }
+        return;
+    }
+    if (!priority) {
+        // Only server needs this, and it is not saved with the Scene
+        priority = node->CreateComponent<Urho3D::NetworkPriority>(Urho3D::LOCAL);
+        priority->SetTemporary(true);
+    }
+
+    priority->SetMinPriority(0);
+    priority->SetAlwaysUpdateOwner(true);
+    if (node_relevance == RELEVANCE_OWNER_ONLY) {
+        priority->SetBasePriority(0);
+        priority->SetDistanceFactor(0);
+    } else {
+        // Priority of 100 or more means update is sent every time. Priority
+        // drops to zero over the hysteresis distance outside relevance.
+        float distance = app->getRelevanceDistance();
+        float hysteresis = Urho3D::Max(app->getRelevanceHysteresis(), 0.001f);
+        priority->SetDistanceFactor(100 / hysteresis);
+        priority->SetBasePriority(100 + 100 * distance / hysteresis);
+    }
+}
+
+void GameObject::OnNodeSet(Urho3D::Node* node)
+{
+    // Get notified when Node moves, and let other
+    // GameObjects of the Node know about this one.
+    if (node) {
+        node->AddListener(this);
+        updateNodeRelevance(nullptr);
+    }
+}
+
+void GameObject::OnSceneSet(Urho3D::Scene* scene)
+{
+    // Node is not known anymore when GameObject is removed from
+    // it, but removing from Scene happens just before that.
+    if (!scene && GetNode()) {
+        updateNodeRelevance(this);
+    }
+
+    // Leave the registry of the previous Scene
+    if (registry) {
+        registry->remove(this);
+        registry.Reset();
+    }
+
+    // Join the registry of the new Scene
+    if (scene) {
+        registry = scene->GetComponent<GameObjectRegistry>();
+        if (registry) {
+            registry->add(this);
+            // Continue sleep that was started outside registry
+            if (sleeping && pending_sleep_duration < Urho3D::M_INFINITY) {
+                registry->sleep(this, pending_sleep_duration);
+            }
+            pending_sleep_duration = Urho3D::M_INFINITY;
+        }
+    }
+}
+
+void GameObject::OnMarkedDirty(Urho3D::Node* node)
+{
+    (void)node;
+    ++ moves;
+    if (registry) {
+        registry->markMoved(this);
+    }
+}
+
 }
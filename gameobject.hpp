@@ -1,11 +1,15 @@
 #ifndef GAMELIB_GAMEOBJECT_HPP
 #define GAMELIB_GAMEOBJECT_HPP
 
+#include "gameobjectregistry.hpp"
 #include "shape.hpp"
+#include "timerwheel.hpp"
 
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Input/Controls.h>
 #include <Urho3D/Math/Ray.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Container/Ptr.h>
 #include <Urho3D/Scene/Component.h>
 
 namespace GameLib
@@ -13,42 +17,194 @@ namespace GameLib
 
 class App;
 
+// One contact point of physics collision. Normal points
+// from the other body towards the body of GameObject.
+struct PhysicsContact
+{
+    Urho3D::Vector3 pos;
+    Urho3D::Vector3 normal;
+    float distance;
+    float impulse;
+};
+
+class GameObject;
+
+// Ray of batched hitscan. Use infinite max distance only when
+// needed, because such rays cannot share octree queries.
+struct HitscanRay
+{
+    Urho3D::Ray ray;
+    float max_distance;
+};
+
+struct HitscanResult
+{
+    // Null if no GameObject accepted the hit
+    Urho3D::WeakPtr<GameObject> gameobj;
+    Urho3D::Vector3 pos;
+    float distance;
+};
+
 class GameObject : public Urho3D::Component
 {
     URHO3D_OBJECT(GameObject, Urho3D::Component);
 
 public:
 
+    // Which clients receive network updates of the Node
+    enum Relevance
+    {
+        // Clients whose controlled Node is near
+        RELEVANCE_DISTANCE,
+        RELEVANCE_ALWAYS,
+        // Only the client that owns the Node. Other clients still get the
+        // Node with its initial state, because Urho3D replicates every Node
+        // to every client, but it is kept hidden from them.
+        RELEVANCE_OWNER_ONLY
+    };
+
     GameObject(Urho3D::Context* context);
     virtual ~GameObject();
 
     // Sets if this GameObject is interested about physics collisions. This only
     // happens on server side and by default GameObjects are not interested.
+    // Collisions are reported for RigidBodies in the Node of this GameObject
+    // and in its child Nodes, also ones added later, except for child Nodes
+    // that have GameObjects of their own. Urho3D creates collision events for
+    // every colliding pair, but pairs whose GameObjects are not interested
+    // are dropped before contacts are read.
     void setHandlesPhysicsCollisions(bool handles_physics_collisions);
 
     bool getHandlesPhysicsCollisions() const;
 
+    // Sets if runServerSide() of this GameObject can be run in a worker thread.
+    // This only has an effect if App enables parallel server tick. Such
+    // GameObjects may only modify their own Node and must not create or remove
+    // Nodes, move physics bodies, send network events or do hitscans or
+    // explosions. They may put themselves to sleep, though. If
+    // runServerSide() returns false, the Node is destroyed
+    // after all parallel GameObjects have been run.
+    void setRunsInParallel(bool runs_in_parallel);
+
+    bool getRunsInParallel() const;
+
+    // On client, GameObjects that are far away or outside the view are run less
+    // often, with the time in between added to deltatime. This makes them run
+    // every frame anyway. Use it for things whose looks depend on smooth
+    // runClientSide(), or that must react in time, like sounds.
+    void setAlwaysRunsOnClient(bool always_runs_on_client);
+
+    bool getAlwaysRunsOnClient() const;
+
+    // Sets who receives network updates of the Node on server. By default,
+    // updates are sent to clients whose controlled Node is within relevance
+    // distance of App. Farther away, updates are sent less and less often,
+    // and beyond the hysteresis distance, not at all. Nodes are still created
+    // and removed on every client, because Urho3D replicates them to all, but
+    // clients that do not get updates are told to hide the Node, so it does
+    // not stay frozen where it was. If the Node has multiple GameObjects,
+    // then the most permissive relevance of them is used.
+    void setRelevance(Relevance relevance);
+
+    Relevance getRelevance() const;
+
+    // Most permissive relevance of the GameObjects of given Node. This is
+    // cached in every GameObject of the Node, and updated when relevance
+    // is set or GameObjects are added to or removed from the Node.
+    static Relevance getNodeRelevance(Urho3D::Node* node);
+    Relevance getNodeRelevance() const;
+
+    // Returns if the Node gets network updates when they are sent to given
+    // Connection. With margin, the Node must be that much nearer than where
+    // updates stop. This is only meaningful on server.
+    bool isRelevantTo(Urho3D::Connection* conn, float margin = 0) const;
+
+    // Returns how many times the Node has moved since the previous
+    // call. This is used for estimating network traffic.
+    unsigned popMoveCount();
+
+    // Sleeping GameObjects are not run on server or client. They are woken by
+    // hitscans, explosions and physics collisions with GameObjects that handle
+    // them, or by calling wake(). If duration is given, then GameObject
+    // also wakes after that many seconds. If GameObject is not in a Scene
+    // yet, then the duration starts when it is added to one.
+    void sleep();
+    void sleep(float duration);
+    void wake();
+
+    bool isSleeping() const;
+
+    // Sets if hitscans can be rewound to past positions of this GameObject. Past
+    // bounds are recorded on server after every tick, and rewound hitscans test
+    // against them instead of current geometry. App limits how many GameObjects
+    // can be compensated and how far back history goes.
+    void setLagCompensated(bool lag_compensated);
+
+    bool getLagCompensated() const;
+
+    // Returns how many seconds hitscans of this GameObject should be rewound.
+    // This is the round trip time of the Connection that owns the Node, because
+    // the client saw the world half of it ago, and the shot took the other half
+    // to arrive, plus the interpolation delay the client shows other Nodes with.
+    // Returns zero if the Node is not owned by any Connection.
+    float getLagCompensationRewind() const;
+
+    // Calls callback on the thread that runs GameObjects after given amount
+    // of seconds. Timers are not called after the GameObject is removed from
+    // the Scene. Returns ID that can be used to cancel the timer, or zero
+    // if the GameObject is not in a Scene, in which case nothing is scheduled.
+    TimerWheel::TimerId scheduleTimer(float delay, TimerWheel::Callback const& callback);
+
+    void cancelTimer(TimerWheel::TimerId id);
+
     // Called on client by GameState
     void setApp(App* app);
+    // Tells if handleAddedToClient() has been called
+    bool isAddedToClient() const;
+    void setAddedToClient();
+    // Adds time that passed without runClientSide() being called,
+    // and returns the total. Pop returns it and starts again.
+    float addClientDeltatime(float deltatime);
+    float popClientDeltatime();
 
     // This is only called on server and in editor
     void finishCreation(App* app, bool enable_physics = true, Urho3D::VariantMap* data = NULL);
 
-    // Return false if GameObject should be destroyed
+    // These are only called for GameObjects whose Node is a direct child of
+    // the Scene. GameObjects of child Nodes get hitscans, explosions, collisions
+    // and timers, but their root GameObject must run them if needed. Return
+    // false if the root Node should be destroyed.
     virtual bool runServerSide(float deltatime, Urho3D::Controls const* controls);
 
-    // Return false if GameObject should be destroyed
     virtual bool runClientSide(float deltatime);
 
+    // If this returns true, then client predicts the movement of its own
+    // controlled GameObject by calling runPrediction() every frame, and
+    // replays inputs when server disagrees. runPrediction() may only change
+    // position and rotation of the Node, and it should move the Node the
+    // same way runServerSide() does with the same controls. On server,
+    // GameObjects of such controlled Node are run once per input of the
+    // client, with the deltatime of the input, instead of once per tick.
+    virtual bool supportsPrediction() const;
+
+    virtual void runPrediction(float deltatime, Urho3D::Controls const& controls);
+
     // This is only called on server and in editor
     virtual void handleCreated(bool enable_physics, Urho3D::VariantMap* data);
 
+    // Called on client some time after replication has added this. When
+    // joining, there are many GameObjects, so this is spread over frames.
+    // runClientSide() is not called before this.
     virtual void handleAddedToClient();
 
     virtual bool handleHitscan(Urho3D::Vector3 const& pos, Urho3D::Vector3 const& dir);
 
     virtual void handleExplosion(Urho3D::Vector3 const& pos);
 
+    // Called once per colliding pair with all contact points of the pair. By
+    // default this calls handlePhysicsCollision() once for every contact.
+    virtual void handlePhysicsCollisions(PhysicsContact const* contacts, unsigned contacts_count, Urho3D::Node* node, GameObject* obj);
+
     virtual void handlePhysicsCollision(Urho3D::Vector3 const& pos, Urho3D::Vector3 const& normal, float distance, Urho3D::Node* node, GameObject* obj);
 
     virtual bool receiveDecals() const;
@@ -59,19 +215,67 @@ public:
 
     virtual Shape getPlacementShape() const;
 
-    bool hitscan(Urho3D::Vector3& result_hitpos, Urho3D::Ray const& ray);
+    // If rewind is given, then lag compensated GameObjects
+    // are hit where they were that many seconds ago.
+    bool hitscan(Urho3D::Vector3& result_hitpos, Urho3D::Ray const& ray, float rewind = 0);
+
+    // Does multiple hitscans at once. Rays with finite max distance that are
+    // near each other share one octree query, and if requested, rays are tested against
+    // geometry in worker threads. handleHitscan() is always called on this
+    // thread in the order of rays, so results do not depend on threads.
+    // There will be one result per ray.
+    void hitscan(Urho3D::Vector<HitscanResult>& results, Urho3D::PODVector<HitscanRay> const& rays, bool use_worker_threads = false, float rewind = 0);
 
-    void explosion(Urho3D::Vector3 const& pos);
+    // Calls handleExplosion() of GameObjects whose Nodes are within radius.
+    // With infinite radius, all GameObjects of root Nodes are notified and
+    // woken, so only use it when the explosion really reaches everything.
+    void explosion(Urho3D::Vector3 const& pos, float radius);
 
 protected:
 
     App* getApp() const;
 
+    void OnNodeSet(Urho3D::Node* node) override;
+    void OnSceneSet(Urho3D::Scene* scene) override;
+    void OnMarkedDirty(Urho3D::Node* node) override;
+
 private:
 
+    friend class GameObjectRegistry;
+    friend class LagCompensation;
+
     App* app;
 
     bool handles_physics_collisions;
+    bool runs_in_parallel;
+    bool lag_compensated;
+    bool always_runs_on_client;
+    Relevance relevance;
+    Relevance node_relevance;
+    bool added_to_client;
+
+    // Time that has passed since runClientSide() was last called
+    float client_deltatime_accumulator;
+
+    // Registry of the Scene this GameObject is in, and the indices in it
+    Urho3D::WeakPtr<GameObjectRegistry> registry;
+    unsigned registry_indices[GameObjectRegistry::LIST_TYPES_COUNT];
+    unsigned hit_history_slot;
+    unsigned spatial_item;
+    unsigned moves;
+
+    bool sleeping;
+    TimerWheel::TimerId sleep_timer;
+    // Duration of sleep that was started without registry
+    float pending_sleep_duration;
+
+    // Updates cached relevance of all GameObjects of the Node. If a
+    // GameObject is leaving the Node, then it is given here.
+    void updateNodeRelevance(GameObject const* leaving);
+
+    // Sets up NetworkPriority of the Node based on relevance
+    // of all its GameObjects. Does nothing on client.
+    void updateNetworkPriority();
 };
 
 }
@@ -0,0 +1,350 @@
+#include "gameobjectregistry.hpp"
+
+#include "gameobject.hpp"
+
+namespace GameLib
+{
+
+GameObjectRegistry::GameObjectRegistry(Urho3D::Context* context) :
+    Urho3D::Component(context),
+    iteration_locks(0),
+    lag_compensation(this),
+    collision_dispatcher(new CollisionDispatcher(context, this))
+{
+    for (unsigned i = 0; i < LIST_TYPES_COUNT; ++ i) {
+        has_empty_slots[i] = false;
+    }
+}
+
+GameObjectRegistry::~GameObjectRegistry()
+{
+}
+
+unsigned GameObjectRegistry::getNumGameObjects() const
+{
+    return lists[ALL].Size();
+}
+
+GameObject* GameObjectRegistry::getGameObject(unsigned index) const
+{
+    return lists[ALL][index];
+}
+
+unsigned GameObjectRegistry::getNumAwakeGameObjects() const
+{
+    return lists[AWAKE].Size();
+}
+
+GameObject* GameObjectRegistry::getAwakeGameObject(unsigned index) const
+{
+    return lists[AWAKE][index];
+}
+
+unsigned GameObjectRegistry::getNumLagCompensatedGameObjects() const
+{
+    return lists[LAG_COMPENSATED].Size();
+}
+
+GameObject* GameObjectRegistry::getLagCompensatedGameObject(unsigned index) const
+{
+    return lists[LAG_COMPENSATED][index];
+}
+
+void GameObjectRegistry::lockIteration()
+{
+    ++ iteration_locks;
+}
+
+void GameObjectRegistry::unlockIteration()
+{
+    assert(iteration_locks > 0);
+    -- iteration_locks;
+    if (!iteration_locks) {
+        for (unsigned i = 0; i < LIST_TYPES_COUNT; ++ i) {
+            if (has_empty_slots[i]) {
+                removeEmptySlots(ListType(i));
+            }
+        }
+    }
+}
+
+TimerWheel& GameObjectRegistry::getTimers()
+{
+    return timers;
+}
+
+LagCompensation& GameObjectRegistry::getLagCompensation()
+{
+    return lag_compensation;
+}
+
+CollisionDispatcher* GameObjectRegistry::getCollisionDispatcher() const
+{
+    return collision_dispatcher;
+}
+
+GameObject* GameObjectRegistry::findGameObject(Urho3D::Node* node) const
+{
+    while (node) {
+        NodeGameObjects::ConstIterator node_gameobjs_find = node_gameobjs.Find(node);
+        if (node_gameobjs_find != node_gameobjs.End()) {
+            return node_gameobjs_find->second_;
+        }
+        node = node->GetParent();
+    }
+    return nullptr;
+}
+
+Urho3D::Node* GameObjectRegistry::findGameObjectNode(Urho3D::Node* node) const
+{
+    while (node && !node_gameobjs.Contains(node)) {
+        node = node->GetParent();
+    }
+    return node;
+}
+
+void GameObjectRegistry::findGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& center, float radius)
+{
+    updateSpatialGrid();
+    spatial_grid.findInSphere(result, center, radius);
+}
+
+void GameObjectRegistry::findGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::BoundingBox const& box)
+{
+    updateSpatialGrid();
+    spatial_grid.findInBox(result, box);
+}
+
+void GameObjectRegistry::findNearestGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& pos, unsigned count, float max_distance)
+{
+    updateSpatialGrid();
+    spatial_grid.findNearest(result, pos, count, max_distance);
+}
+
+void GameObjectRegistry::setSpatialCellSize(float cell_size)
+{
+    spatial_grid.setCellSize(cell_size);
+}
+
+unsigned GameObjectRegistry::getNumRelevanceChangedGameObjects() const
+{
+    return lists[RELEVANCE_CHANGED].Size();
+}
+
+GameObject* GameObjectRegistry::getRelevanceChangedGameObject(unsigned index) const
+{
+    return lists[RELEVANCE_CHANGED][index];
+}
+
+void GameObjectRegistry::clearRelevanceChanged()
+{
+    GameObjects& changed = lists[RELEVANCE_CHANGED];
+    for (unsigned i = 0; i < changed.Size(); ++ i) {
+        if (changed[i]) {
+            changed[i]->registry_indices[RELEVANCE_CHANGED] = Urho3D::M_MAX_UNSIGNED;
+        }
+    }
+    changed.Clear();
+    has_empty_slots[RELEVANCE_CHANGED] = false;
+}
+
+void GameObjectRegistry::add(GameObject* gameobj)
+{
+    addToList(ALL, gameobj);
+    if (!gameobj->sleeping) {
+        addToList(AWAKE, gameobj);
+    }
+    if (gameobj->lag_compensated) {
+        addToList(LAG_COMPENSATED, gameobj);
+        lag_compensation.start(gameobj);
+    }
+    markMoved(gameobj);
+    markRelevanceChanged(gameobj);
+
+    Urho3D::Node* node = gameobj->GetNode();
+    if (node && !node_gameobjs.Contains(node)) {
+        node_gameobjs[node] = gameobj;
+    }
+}
+
+void GameObjectRegistry::remove(GameObject* gameobj)
+{
+    cancelSleepTimer(gameobj);
+    removeFromList(ALL, gameobj);
+    if (!gameobj->sleeping) {
+        removeFromList(AWAKE, gameobj);
+    }
+    if (gameobj->lag_compensated) {
+        removeFromList(LAG_COMPENSATED, gameobj);
+        lag_compensation.stop(gameobj);
+    }
+    if (gameobj->registry_indices[MOVED] != Urho3D::M_MAX_UNSIGNED) {
+        removeFromList(MOVED, gameobj);
+    }
+    if (gameobj->registry_indices[RELEVANCE_CHANGED] != Urho3D::M_MAX_UNSIGNED) {
+        removeFromList(RELEVANCE_CHANGED, gameobj);
+    }
+    if (gameobj->spatial_item != SpatialGrid::NO_ITEM) {
+        spatial_grid.remove(gameobj->spatial_item);
+        gameobj->spatial_item = SpatialGrid::NO_ITEM;
+    }
+
+    // If this was the GameObject of its Node, then
+    // replace it with another one from the same Node.
+    Urho3D::Node* node = gameobj->GetNode();
+    NodeGameObjects::Iterator node_gameobjs_find = node_gameobjs.Find(node);
+    if (node_gameobjs_find != node_gameobjs.End() && node_gameobjs_find->second_ == gameobj) {
+        node_gameobjs.Erase(node_gameobjs_find);
+        for (Urho3D::Component* comp : node->GetComponents()) {
+            if (comp != gameobj && comp->IsInstanceOf<GameObject>()) {
+                GameObject* other = static_cast<GameObject*>(comp);
+                if (other->registry.Get() == this) {
+                    node_gameobjs[node] = other;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void GameObjectRegistry::sleep(GameObject* gameobj, float duration)
+{
+    Urho3D::MutexLock lock(mutex);
+
+    if (!gameobj->sleeping) {
+        gameobj->sleeping = true;
+        removeFromList(AWAKE, gameobj);
+    }
+
+    // Replace possible previous sleep timer
+    cancelSleepTimer(gameobj);
+    if (duration < Urho3D::M_INFINITY) {
+        gameobj->sleep_timer = timers.schedule(uint64_t(duration * 1000), [this, gameobj]() {
+            gameobj->sleep_timer = 0;
+            wake(gameobj);
+        });
+    }
+}
+
+void GameObjectRegistry::wake(GameObject* gameobj)
+{
+    Urho3D::MutexLock lock(mutex);
+
+    cancelSleepTimer(gameobj);
+    if (gameobj->sleeping) {
+        gameobj->sleeping = false;
+        addToList(AWAKE, gameobj);
+    }
+}
+
+void GameObjectRegistry::setLagCompensated(GameObject* gameobj, bool lag_compensated)
+{
+    if (lag_compensated == gameobj->lag_compensated) {
+        return;
+    }
+    gameobj->lag_compensated = lag_compensated;
+    if (lag_compensated) {
+        addToList(LAG_COMPENSATED, gameobj);
+        lag_compensation.start(gameobj);
+    } else {
+        removeFromList(LAG_COMPENSATED, gameobj);
+        lag_compensation.stop(gameobj);
+    }
+}
+
+void GameObjectRegistry::markMoved(GameObject* gameobj)
+{
+    Urho3D::MutexLock lock(mutex);
+
+    if (gameobj->registry_indices[MOVED] == Urho3D::M_MAX_UNSIGNED) {
+        addToList(MOVED, gameobj);
+    }
+}
+
+void GameObjectRegistry::markRelevanceChanged(GameObject* gameobj)
+{
+    Urho3D::MutexLock lock(mutex);
+
+    if (gameobj->registry_indices[RELEVANCE_CHANGED] == Urho3D::M_MAX_UNSIGNED) {
+        addToList(RELEVANCE_CHANGED, gameobj);
+    }
+}
+
+void GameObjectRegistry::registerObject(Urho3D::Context* context)
+{
+    context->RegisterFactory<GameObjectRegistry>();
+}
+
+void GameObjectRegistry::cancelSleepTimer(GameObject* gameobj)
+{
+    if (gameobj->sleep_timer) {
+        timers.cancel(gameobj->sleep_timer);
+        gameobj->sleep_timer = 0;
+    }
+}
+
+void GameObjectRegistry::updateSpatialGrid()
+{
+    GameObjects& moved = lists[MOVED];
+    for (unsigned i = 0; i < moved.Size(); ++ i) {
+        GameObject* gameobj = moved[i];
+        if (!gameobj) {
+            continue;
+        }
+        Urho3D::Vector3 pos = gameobj->GetNode()->GetWorldPosition();
+        if (gameobj->spatial_item == SpatialGrid::NO_ITEM) {
+            gameobj->spatial_item = spatial_grid.insert(gameobj, pos);
+        } else {
+            spatial_grid.move(gameobj->spatial_item, pos);
+        }
+        gameobj->registry_indices[MOVED] = Urho3D::M_MAX_UNSIGNED;
+    }
+    moved.Clear();
+}
+
+void GameObjectRegistry::addToList(ListType list, GameObject* gameobj)
+{
+    GameObjects& gameobjs = lists[list];
+    assert(gameobj->registry_indices[list] == Urho3D::M_MAX_UNSIGNED);
+    gameobj->registry_indices[list] = gameobjs.Size();
+    gameobjs.Push(gameobj);
+}
+
+void GameObjectRegistry::removeFromList(ListType list, GameObject* gameobj)
+{
+    GameObjects& gameobjs = lists[list];
+    unsigned index = gameobj->registry_indices[list];
+    assert(index < gameobjs.Size() && gameobjs[index] == gameobj);
+
+    // If iterating, then only leave an empty slot
+    if (iteration_locks) {
+        gameobjs[index] = nullptr;
+        has_empty_slots[list] = true;
+    }
+    // Otherwise move the last GameObject to the place of the removed one
+    else {
+        GameObject* last = gameobjs.Back();
+        gameobjs[index] = last;
+        last->registry_indices[list] = index;
+        gameobjs.Pop();
+    }
+
+    gameobj->registry_indices[list] = Urho3D::M_MAX_UNSIGNED;
+}
+
+void GameObjectRegistry::removeEmptySlots(ListType list)
+{
+    GameObjects& gameobjs = lists[list];
+    unsigned new_size = 0;
+    for (unsigned i = 0; i < gameobjs.Size(); ++ i) {
+        GameObject* gameobj = gameobjs[i];
+        if (gameobj) {
+            gameobj->registry_indices[list] = new_size;
+            gameobjs[new_size ++] = gameobj;
+        }
+    }
+    gameobjs.Resize(new_size);
+    has_empty_slots[list] = false;
+}
+
+}
@@ -0,0 +1,148 @@
+#ifndef GAMELIB_GAMEOBJECTREGISTRY_HPP
+#define GAMELIB_GAMEOBJECTREGISTRY_HPP
+
+#include "collisiondispatcher.hpp"
+#include "lagcompensation.hpp"
+#include "spatialgrid.hpp"
+#include "timerwheel.hpp"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+
+namespace GameLib
+{
+
+class GameObject;
+
+// Keeps all GameObjects of a Scene in a dense array, so they can be iterated
+// without walking the Scene and casting components. GameObjects join and leave
+// the registry by themselves when they are added to or removed from the Scene.
+// GameObjects that are not sleeping are also kept in a separate array, so
+// sleeping GameObjects do not need to be visited when running GameObjects.
+// Positions of GameObjects are kept in a spatial grid, which is updated
+// lazily, only for GameObjects whose Nodes have moved since the last query.
+// GameObjects of child Nodes are registered too, but ServerState and
+// GameState only run the ones whose Node is a direct child of the Scene.
+// Timers, lag compensation and collision dispatching are separate classes
+// that the registry holds, because they need the same GameObjects.
+class GameObjectRegistry : public Urho3D::Component
+{
+    URHO3D_OBJECT(GameObjectRegistry, Urho3D::Component);
+
+public:
+
+    // Lists that GameObjects are kept in. Every GameObject
+    // remembers its index in each of them, so it can be removed fast.
+    enum ListType
+    {
+        ALL,
+        AWAKE,
+        LAG_COMPENSATED,
+        MOVED,
+        RELEVANCE_CHANGED,
+        LIST_TYPES_COUNT
+    };
+
+    GameObjectRegistry(Urho3D::Context* context);
+    virtual ~GameObjectRegistry();
+
+    // GameObjects are iterated by index. If a GameObject is removed or put to
+    // sleep while iteration is locked, its slot becomes null. New and woken
+    // GameObjects are always added to the end.
+    unsigned getNumGameObjects() const;
+    GameObject* getGameObject(unsigned index) const;
+    unsigned getNumAwakeGameObjects() const;
+    GameObject* getAwakeGameObject(unsigned index) const;
+    unsigned getNumLagCompensatedGameObjects() const;
+    GameObject* getLagCompensatedGameObject(unsigned index) const;
+
+    // Iteration must be locked if GameObjects might get added, removed, put
+    // to sleep or woken during it. Locks can be nested.
+    void lockIteration();
+    void unlockIteration();
+
+    // ServerState and GameState advance timers before running GameObjects,
+    // so timers are fired on the thread that runs them. Timers also wake
+    // GameObjects whose sleep has ended.
+    TimerWheel& getTimers();
+
+    // History of lag compensated GameObjects and delays of clients
+    LagCompensation& getLagCompensation();
+
+    // Reports physics collisions of the Scene to GameObjects
+    CollisionDispatcher* getCollisionDispatcher() const;
+
+    // Returns GameObject of given Node, or of its closest ancestor
+    // that has one. Returns null if there is no such GameObject. If
+    // the Node has multiple GameObjects, then one of them is returned.
+    GameObject* findGameObject(Urho3D::Node* node) const;
+    // Returns given Node or its closest ancestor that has GameObjects
+    Urho3D::Node* findGameObjectNode(Urho3D::Node* node) const;
+
+    // Find GameObjects by the world positions of their Nodes. Results
+    // are appended to the given array. Nearest GameObjects are sorted
+    // by distance. These must not be called from worker threads.
+    void findGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& center, float radius);
+    void findGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::BoundingBox const& box);
+    void findNearestGameObjects(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& pos, unsigned count, float max_distance = Urho3D::M_INFINITY);
+
+    // Should be about the radius of typical queries
+    void setSpatialCellSize(float cell_size);
+
+    // GameObjects that have been added, or whose Node relevance has changed,
+    // since the list was last cleared. ServerState checks these for every
+    // client, and only checks Nodes near clients otherwise.
+    unsigned getNumRelevanceChangedGameObjects() const;
+    GameObject* getRelevanceChangedGameObject(unsigned index) const;
+    void clearRelevanceChanged();
+
+    // These are called by GameObject
+    void add(GameObject* gameobj);
+    void remove(GameObject* gameobj);
+    void sleep(GameObject* gameobj, float duration);
+    void wake(GameObject* gameobj);
+    void setLagCompensated(GameObject* gameobj, bool lag_compensated);
+    void markMoved(GameObject* gameobj);
+    void markRelevanceChanged(GameObject* gameobj);
+
+    static void registerObject(Urho3D::Context* context);
+
+private:
+
+    typedef Urho3D::PODVector<GameObject*> GameObjects;
+    typedef Urho3D::HashMap<Urho3D::Node*, GameObject*> NodeGameObjects;
+
+    GameObjects lists[LIST_TYPES_COUNT];
+    bool has_empty_slots[LIST_TYPES_COUNT];
+
+    unsigned iteration_locks;
+
+    // If a Node has multiple GameObjects, then only one of them is here
+    NodeGameObjects node_gameobjs;
+
+    TimerWheel timers;
+    LagCompensation lag_compensation;
+    Urho3D::SharedPtr<CollisionDispatcher> collision_dispatcher;
+
+    SpatialGrid spatial_grid;
+
+    // Sleeping, waking and moving can happen from worker threads
+    Urho3D::Mutex mutex;
+
+    void cancelSleepTimer(GameObject* gameobj);
+
+    // Updates spatial grid with GameObjects that have moved
+    void updateSpatialGrid();
+
+    void addToList(ListType list, GameObject* gameobj);
+    void removeFromList(ListType list, GameObject* gameobj);
+    void removeEmptySlots(ListType list);
+};
+
+}
+
+#endif
@@ -2,7 +2,9 @@
 
 #include "app.hpp"
 #include "gameobject.hpp"
+#include "gameobjectregistry.hpp"
 #include "network.hpp"
+#include "tickprofiler.hpp"
 
 #include <Urho3D/Audio/Audio.h>
 #include <Urho3D/Audio/Sound.h>
@@ -11,19 +13,28 @@
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/DecalSet.h>
 #include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/Octree.h>
 #include <Urho3D/Graphics/Texture2D.h>
 #include <Urho3D/Input/Input.h>
-#include <Urho3D/IO/Log.h>
 #include <Urho3D/Network/Network.h>
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/Scene/SceneEvents.h>
 
+#include <chrono>
 #include <ctime>
 
 namespace GameLib
 {
 
-unsigned const MAX_DECALS = 10000;
+// How far server may be from prediction before inputs are replayed
+float const PREDICTION_TOLERANCE = 0.01f;
+
+// If server does not acknowledge inputs, the oldest ones are forgotten
+unsigned const MAX_PREDICTED_INPUTS = 256;
+
+// Nodes this close to the view are treated as visible, because
+// their geometry may reach into it even if the origin does not.
+float const CLIENT_TICK_VIEW_MARGIN = 2.0f;
 
 GameState::GameState(App* app, Urho3D::Context* context, Urho3D::String const& host, uint16_t port) :
     SceneRendererState(app, context),
@@ -31,10 +42,30 @@ GameState::GameState(App* app, Urho3D::Context* context, Urho3D::String const& h
     yaw(0),
     pitch(0),
     get_yaw_and_pitch_from_gameobject(false),
-    decals_total(0)
+    added_gameobjs(0),
+    input_sequence(0),
+    has_prediction(false),
+    prediction_ack_received(false),
+    acked_sequence(0)
 {
+    decals.setBudget(app->getMaxDecals(), app->getMaxDecalMemory());
+    decals.setDrawDistance(app->getDecalDrawDistance());
+    decals.setMaxTargetTriangles(app->getMaxDecalTargetTriangles());
+
+    interpolator = new SnapshotInterpolator(context);
+    interpolator->setDelay(app->getInterpolationDelay(), 2);
+    interpolator->setMaxExtrapolation(app->getMaxExtrapolation());
+
+    network_stats.setLogInterval(app->getNetworkStatsLogInterval());
+
+    // Inputs are sent as often as Urho3D sends its own updates. Those
+    // cannot be turned off, but Controls of the server Connection are
+    // never set, so they stay as small as they can. Network statistics
+    // show the real total rate of the Connection and the share of inputs.
+    input_sender.setSendRate(GetSubsystem<Urho3D::Network>()->GetUpdateFps());
+
     // Camera and listener
-    Urho3D::Node* camera_node = app->getScene()->CreateChild("camera", Urho3D::LOCAL);
+    Urho3D::Node* camera_node = createCameraNode();
     Urho3D::Camera* camera = camera_node->CreateComponent<Urho3D::Camera>();
     camera->SetFarClip(app->getFogEndDistance());
     Urho3D::SoundListener* listener = camera_node->CreateComponent<Urho3D::SoundListener>();
@@ -57,7 +88,13 @@ void GameState::show()
     SubscribeToEvent(Urho3D::E_UPDATE, URHO3D_HANDLER(GameState, handleUpdate));
     SubscribeToEvent(Urho3D::E_COMPONENTADDED, URHO3D_HANDLER(GameState, handleComponentAdded));
     SubscribeToEvent(E_TO_CLIENT_SET_CONTROLLED_NODE, URHO3D_HANDLER(GameState, handleSetControlledNode));
+    SubscribeToEvent(E_TO_CLIENT_PREDICTION_ACK, URHO3D_HANDLER(GameState, handlePredictionAck));
+    SubscribeToEvent(E_TO_CLIENT_SERVER_INFO, URHO3D_HANDLER(GameState, handleServerInfo));
+    SubscribeToEvent(E_TO_CLIENT_RELEVANCE_CHANGED, URHO3D_HANDLER(GameState, handleRelevanceChanged));
     GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE);
+    GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(E_TO_CLIENT_PREDICTION_ACK);
+    GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(E_TO_CLIENT_SERVER_INFO);
+    GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(E_TO_CLIENT_RELEVANCE_CHANGED);
 
     // Subscribe to custom network events
     Urho3D::Vector<Urho3D::StringHash> network_events;
@@ -67,6 +104,7 @@ void GameState::show()
         SubscribeToEvent(network_event, URHO3D_HANDLER(GameState, handleCustomNetworkEvent));
         GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(network_event);
     }
+    network_stats.setEventTypes(network_events);
 
     // Hide mouse cursor
     GetSubsystem<Urho3D::Input>()->SetMouseVisible(false);
@@ -81,6 +119,9 @@ void GameState::hide()
     UnsubscribeFromEvent(Urho3D::E_UPDATE);
     UnsubscribeFromEvent(Urho3D::E_COMPONENTADDED);
     UnsubscribeFromEvent(E_TO_CLIENT_SET_CONTROLLED_NODE);
+    UnsubscribeFromEvent(E_TO_CLIENT_PREDICTION_ACK);
+    UnsubscribeFromEvent(E_TO_CLIENT_SERVER_INFO);
+    UnsubscribeFromEvent(E_TO_CLIENT_RELEVANCE_CHANGED);
 
     // Unsubscribe from custom network events
     Urho3D::Vector<Urho3D::StringHash> network_events;
@@ -93,41 +134,63 @@ void GameState::hide()
     getApp()->setGameState(NULL);
 }
 
-void GameState::addDecalsRecursively(Urho3D::Node* node, Urho3D::Frustum const& frustum, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end)
+void GameState::addDecals(Urho3D::Frustum const& frustum, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end)
 {
-    // Call children recursively
-    for (unsigned child_i = 0; child_i < node->GetNumChildren(); ++ child_i) {
-        Urho3D::Node* child = node->GetChild(child_i);
-        addDecalsRecursively(child, frustum, mat, pos, rot, size, aspect, depth, uv_begin, uv_end);
+    Urho3D::Octree* octree = getApp()->getScene()->GetComponent<Urho3D::Octree>();
+    GameObjectRegistry* registry = getApp()->getGameObjectRegistry();
+    if (!octree || !registry) {
+        return;
     }
-    // Add all drawable components in this node
-    Urho3D::DecalSet* decalset = NULL;
-    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Component> > comps = node->GetComponents();
-    for (unsigned comp_i = 0; comp_i < comps.Size(); ++ comp_i) {
-        Urho3D::Component* comp = comps[comp_i];
-        Urho3D::Drawable* drawable = dynamic_cast<Urho3D::Drawable*>(comp);
-        Urho3D::DecalSet* decalset_check = dynamic_cast<Urho3D::DecalSet*>(comp);
-        if (drawable && !decalset_check && frustum.IsInside(drawable->GetWorldBoundingBox()) != Urho3D::OUTSIDE) {
-            if (!decalset) {
-                decalset = node->GetComponent<Urho3D::DecalSet>();
-                if (decalset) {
-                    if (decalset->GetMaterial() != mat) {
-                        URHO3D_LOGERROR("Currently only one decal set material is supported per node!");
-                        return;
-                    }
-                } else {
-                    decalset = drawable->GetNode()->CreateComponent<Urho3D::DecalSet>();
-                    decalset->SetMaterial(mat);
-                }
-            }
-            if (decalset->AddDecal(drawable, pos, rot, size, aspect, depth, uv_begin, uv_end)) {
-                // Keep track of total decal count
-                ++ decals_total;
-            }
+
+    // Decals that are too far away to be drawn are not created at all
+    Urho3D::Node* camera_node = getCameraNode();
+    float draw_distance = getApp()->getDecalDrawDistance();
+    if (camera_node && draw_distance > 0 && (camera_node->GetWorldPosition() - pos).Length() > draw_distance + size) {
+        return;
+    }
+
+    // Only visit geometry that is near the decal
+    Urho3D::FrustumOctreeQuery query(decal_drawables_buf, frustum, Urho3D::DRAWABLE_GEOMETRY);
+    octree->GetDrawables(query);
+
+    for (Urho3D::Drawable* drawable : decal_drawables_buf) {
+        // Decals are not put on top of other decals
+        if (drawable->IsInstanceOf<Urho3D::DecalSet>()) {
+            continue;
+        }
+        GameObject* gameobj = registry->findGameObject(drawable->GetNode());
+        if (!gameobj || !gameobj->receiveDecals()) {
+            continue;
         }
+
+        // Geometry is clipped later, so impacts do not cause frame drops
+        decals.queueDecal(drawable, mat, pos, rot, size, aspect, depth, uv_begin, uv_end);
     }
 }
 
+DecalManager const& GameState::getDecalManager() const
+{
+    return decals;
+}
+
+unsigned GameState::getNumPendingGameObjects() const
+{
+    return pending_gameobjs.Size();
+}
+
+float GameState::getJoinProgress() const
+{
+    if (pending_gameobjs.Empty()) {
+        return 1;
+    }
+    return float(added_gameobjs) / (added_gameobjs + pending_gameobjs.Size());
+}
+
+NetworkStats& GameState::getNetworkStats()
+{
+    return network_stats;
+}
+
 void GameState::handleKeyDown(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
 {
     (void)event_type;
@@ -146,8 +209,14 @@ void GameState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap&
 
     Urho3D::Connection* conn = GetSubsystem<Urho3D::Network>()->GetServerConnection();
 
+    network_stats.update(deltatime, GetSubsystem<Urho3D::Network>());
+
     getApp()->stepOnClient(deltatime);
 
+    // Finish adding GameObjects that replication has created
+    addControlledGameObjects();
+    addPendingGameObjects(getApp()->getAddGameObjectsTimeBudget());
+
     // Send controls to server
     if (conn) {
         Urho3D::Input* input = GetSubsystem<Urho3D::Input>();
@@ -190,8 +259,12 @@ void GameState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap&
                 getApp()->handleMouseButtonPress(Urho3D::MOUSEB_MIDDLE);
             }
 
+            ++ input_sequence;
+            // Server applies the input with the same deltatime
+            float input_deltatime = InputSender::quantizeDeltatime(deltatime);
+
             // Let possible GameObject in the controlled node modify the controls and set the camera transform
-            Urho3D::Node* camera_node = getApp()->getScene()->GetChild("camera");
+            Urho3D::Node* camera_node = getCameraNode();
             for (unsigned i = 0; i < controlled_node->GetNumComponents(); ++ i) {
                 Urho3D::Component* component = controlled_node->GetComponents()[i];
                 GameObject* gameobj = dynamic_cast<GameObject*>(component);
@@ -199,44 +272,78 @@ void GameState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap&
                     gameobj->modifyControls(&controls);
                     yaw = controls.yaw_;
                     pitch = controls.pitch_;
+                    // Move locally, without waiting for server. Node is predicted
+                    // if server runs it per input, so like server, this checks
+                    // the GameObject that registry has for the Node.
+                    InputSender::quantize(controls);
+                    GameObject* predicted = getApp()->getGameObjectRegistry()->findGameObject(controlled_node);
+                    if (predicted && predicted->GetNode() == controlled_node && predicted->supportsPrediction()) {
+                        runPrediction(controlled_node, controls, input_deltatime);
+                    }
                     camera_node->SetTransform(gameobj->getCameraTransform(&controls));
                     break;
                 }
             }
 
-            conn->SetControls(controls);
+            input_sender.addInput(controls, input_sequence, input_deltatime);
         }
-    }
 
-    // Run game objects
-    Urho3D::HashSet<Urho3D::Node*> removed_nodes;
-    Urho3D::PODVector<Urho3D::Node*> children = getApp()->getScene()->GetChildren(false);
-    for (unsigned i = 0; i < children.Size(); ++ i) {
-        Urho3D::Node* child_node = children[i];
+        input_sender.setInterpolationDelay(interpolator->getDelay());
+        unsigned input_bytes = input_sender.update(conn, deltatime);
+        if (input_bytes) {
+            network_stats.addMessage("input", input_bytes);
+        }
+    }
 
-        // If node was removed, then skip it
-        if (removed_nodes.Contains(child_node)) {
+    // Move other than controlled Nodes to where they were a moment ago
+    interpolator->update(deltatime);
+
+    // Only nearby GameObjects in view are run every frame
+    Urho3D::Node* camera_node = getCameraNode();
+    Urho3D::Camera* camera = camera_node ? camera_node->GetComponent<Urho3D::Camera>() : NULL;
+    Urho3D::Vector3 camera_pos = camera_node ? camera_node->GetWorldPosition() : Urho3D::Vector3::ZERO;
+    Urho3D::Frustum view = camera ? camera->GetFrustum() : Urho3D::Frustum();
+    float full_tick_distance = getApp()->getClientFullTickDistance();
+    float reduced_tick_interval = getApp()->getClientReducedTickInterval();
+
+    // Run game objects that are not sleeping. Like on server,
+    // only GameObjects of root Nodes are run.
+    Urho3D::Scene* scene = getApp()->getScene();
+    GameObjectRegistry* registry = getApp()->getGameObjectRegistry();
+    registry->getTimers().advanceSeconds(deltatime);
+    TickProfiler::update(deltatime);
+    registry->lockIteration();
+    unsigned gameobjs_count = registry->getNumAwakeGameObjects();
+    for (unsigned i = 0; i < gameobjs_count; ++ i) {
+        GameObject* gameobj = registry->getAwakeGameObject(i);
+        // If GameObject was removed or put to sleep, or it has
+        // not been added completely or is hidden, then skip it
+        if (!gameobj || !gameobj->isAddedToClient() || gameobj->GetNode()->GetParent() != scene || !gameobj->GetNode()->IsEnabled()) {
             continue;
         }
-
-        // Run possible GameObjects in this node
-        for (unsigned j = 0; j < child_node->GetNumComponents(); ++ j) {
-            Urho3D::Component* component = child_node->GetComponents()[j];
-            GameObject* gameobj = dynamic_cast<GameObject*>(component);
-            if (gameobj) {
-                if (!gameobj->runClientSide(deltatime)) {
-                    child_node->Remove();
-                    removed_nodes.Insert(child_node);
-                    break;
-                }
+        float accumulated = gameobj->addClientDeltatime(deltatime);
+        if (!gameobj->getAlwaysRunsOnClient() && camera && accumulated < reduced_tick_interval) {
+            Urho3D::Vector3 pos = gameobj->GetNode()->GetWorldPosition();
+            bool near = (pos - camera_pos).Length() < full_tick_distance;
+            if (!near || view.IsInsideFast(Urho3D::Sphere(pos, CLIENT_TICK_VIEW_MARGIN)) == Urho3D::OUTSIDE) {
+                continue;
             }
         }
+        float gameobj_deltatime = gameobj->popClientDeltatime();
+        bool keep;
+        {
+            TickProfiler::Scope profile(gameobj, TickProfiler::RUN_CLIENT_SIDE);
+            keep = gameobj->runClientSide(gameobj_deltatime);
+        }
+        if (!keep) {
+            gameobj->GetNode()->Remove();
+        }
     }
+    registry->unlockIteration();
 
-    // If number of decals grows too big, then clean some of them
-    if (decals_total > MAX_DECALS) {
-        decals_total = reduceDecalsRecursively(getApp()->getScene());
-    }
+    // Decals of removed Nodes are not counted in the budget
+    decals.removeDestroyedDecalSets();
+    decals.addQueuedDecals(getApp()->getDecalTimeBudget());
 }
 
 void GameState::handleComponentAdded(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
@@ -246,7 +353,13 @@ void GameState::handleComponentAdded(Urho3D::StringHash event_type, Urho3D::Vari
     GameObject* gameobj = dynamic_cast<GameObject*>(component);
     if (gameobj) {
         gameobj->setApp(getApp());
-        gameobj->handleAddedToClient();
+        // Controlled Node is moved by prediction instead
+        Urho3D::Node* node = gameobj->GetNode();
+        if (node->IsReplicated() && node->GetID() != controlled_node_id) {
+            interpolator->addNode(node);
+        }
+        // Rest of adding is done later, in frame time budget
+        pending_gameobjs.Push(Urho3D::WeakPtr<GameObject>(gameobj));
     }
 }
 
@@ -255,41 +368,203 @@ void GameState::handleSetControlledNode(Urho3D::StringHash event_type, Urho3D::V
     (void)event_type;
     controlled_node_id = event_data[P_ID].GetUInt();
     get_yaw_and_pitch_from_gameobject = true;
+
+    // Node might have been replicated before it was known to be controlled
+    Urho3D::Node* controlled_node = getApp()->getScene()->GetNode(controlled_node_id);
+    if (controlled_node) {
+        interpolator->removeNode(controlled_node);
+    }
+
+    // Prediction starts over with the new Node
+    predicted_inputs.Clear();
+    has_prediction = false;
+    prediction_ack_received = false;
+}
+
+void GameState::handlePredictionAck(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    // Acks are not ordered, so ignore old ones
+    unsigned sequence = event_data[P_SEQUENCE].GetUInt();
+    if (int(sequence - acked_sequence) <= 0) {
+        return;
+    }
+    prediction_ack_received = true;
+    acked_sequence = sequence;
+    acked_pos = event_data[P_POSITION].GetVector3();
+    acked_rot = event_data[P_ROTATION].GetQuaternion();
+}
+
+void GameState::handleServerInfo(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    int update_rate = event_data[P_UPDATE_RATE].GetInt();
+    if (update_rate > 0) {
+        interpolator->setUpdateInterval(1.0f / update_rate);
+    }
+}
+
+void GameState::handleRelevanceChanged(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    // Nodes might not be replicated yet, so IDs are
+    // remembered, and new GameObjects are checked too.
+    Urho3D::Scene* scene = getApp()->getScene();
+    Urho3D::VariantVector const& hidden = event_data[P_HIDDEN].GetVariantVector();
+    for (unsigned i = 0; i < hidden.Size(); ++ i) {
+        unsigned node_id = hidden[i].GetUInt();
+        hidden_node_ids.insert(node_id);
+        Urho3D::Node* node = scene->GetNode(node_id);
+        if (node) {
+            // Keep the latest state from server
+            interpolator->removeNode(node);
+            node->SetDeepEnabled(false);
+        }
+    }
+    Urho3D::VariantVector const& shown = event_data[P_SHOWN].GetVariantVector();
+    for (unsigned i = 0; i < shown.Size(); ++ i) {
+        unsigned node_id = shown[i].GetUInt();
+        hidden_node_ids.erase(node_id);
+        Urho3D::Node* node = scene->GetNode(node_id);
+        if (node) {
+            node->ResetDeepEnabled();
+            if (node_id != controlled_node_id) {
+                interpolator->addNode(node);
+            }
+        }
+    }
 }
 
 void GameState::handleCustomNetworkEvent(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
 {
+    network_stats.addEvent(event_type, event_data);
     getApp()->handleClientNetworkEvent(event_type, event_data);
 }
 
-unsigned GameState::reduceDecalsRecursively(Urho3D::Node* node)
+void GameState::addPendingGameObjects(float time_budget)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    while (!pending_gameobjs.Empty()) {
+        GameObject* gameobj = pending_gameobjs.Front();
+        pending_gameobjs.PopFront();
+        // Removed GameObjects are just forgotten
+        if (gameobj && gameobj->GetScene()) {
+            addGameObject(gameobj);
+        }
+
+        if (std::chrono::duration<float>(std::chrono::steady_clock::now() - begin).count() >= time_budget) {
+            break;
+        }
+    }
+
+    if (pending_gameobjs.Empty()) {
+        added_gameobjs = 0;
+    }
+}
+
+void GameState::addControlledGameObjects()
 {
-    unsigned new_decal_count = 0;
+    Urho3D::Node* controlled_node = getApp()->getScene()->GetNode(controlled_node_id);
+    if (!controlled_node) {
+        return;
+    }
+    for (unsigned i = 0; i < controlled_node->GetNumComponents(); ++ i) {
+        Urho3D::Component* component = controlled_node->GetComponents()[i];
+        GameObject* gameobj = dynamic_cast<GameObject*>(component);
+        if (gameobj) {
+            addGameObject(gameobj);
+        }
+    }
+}
 
-    // Call children recursively
-    for (unsigned child_i = 0; child_i < node->GetNumChildren(); ++ child_i) {
-        Urho3D::Node* child = node->GetChild(child_i);
-        new_decal_count += reduceDecalsRecursively(child);
+void GameState::addGameObject(GameObject* gameobj)
+{
+    // Controlled GameObjects may have been added already
+    if (gameobj->isAddedToClient()) {
+        return;
+    }
+    gameobj->setAddedToClient();
+    Urho3D::Node* node = gameobj->GetNode();
+    if (hidden_node_ids.count(node->GetID())) {
+        interpolator->removeNode(node);
+        node->SetDeepEnabled(false);
     }
+    gameobj->handleAddedToClient();
+    ++ added_gameobjs;
+}
 
-    // Reduce decals in this node
-    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Component> > comps = node->GetComponents();
-    for (unsigned comp_i = 0; comp_i < comps.Size(); ++ comp_i) {
-        Urho3D::Component* comp = comps[comp_i];
-        Urho3D::DecalSet* decalset = dynamic_cast<Urho3D::DecalSet*>(comp);
-        if (decalset) {
-            decalset->RemoveDecals(1);
-            // If empty, then clear the whole decalset
-            unsigned decalset_decals = decalset->GetNumDecals();
-            if (!decalset_decals) {
-                node->RemoveComponent(comp);
-            } else {
-                new_decal_count += decalset_decals;
+void GameState::runPrediction(Urho3D::Node* node, Urho3D::Controls const& controls, float deltatime)
+{
+    if (prediction_ack_received) {
+        prediction_ack_received = false;
+
+        // Forget inputs that server has already applied. Sequence
+        // numbers are compared so that wrapping around works.
+        bool ack_was_predicted = false;
+        Urho3D::Vector3 predicted_pos_at_ack;
+        Urho3D::Quaternion predicted_rot_at_ack;
+        unsigned applied_inputs = 0;
+        while (applied_inputs < predicted_inputs.Size() && int(predicted_inputs[applied_inputs].sequence - acked_sequence) <= 0) {
+            PredictedInput const& input = predicted_inputs[applied_inputs];
+            if (input.sequence == acked_sequence) {
+                ack_was_predicted = true;
+                predicted_pos_at_ack = input.pos;
+                predicted_rot_at_ack = input.rot;
+            }
+            ++ applied_inputs;
+        }
+        predicted_inputs.Erase(0, applied_inputs);
+
+        // If server ended up somewhere else than predicted, then start from
+        // where server is, and replay inputs it has not applied yet.
+        if (!ack_was_predicted || (predicted_pos_at_ack - acked_pos).Length() > PREDICTION_TOLERANCE || !predicted_rot_at_ack.Equals(acked_rot)) {
+            node->SetPosition(acked_pos);
+            node->SetRotation(acked_rot);
+            for (PredictedInput& input : predicted_inputs) {
+                runNodePrediction(node, input.deltatime, input.controls);
+                input.pos = node->GetPosition();
+                input.rot = node->GetRotation();
             }
+            predicted_pos = node->GetPosition();
+            predicted_rot = node->GetRotation();
+            has_prediction = true;
         }
     }
 
-    return new_decal_count;
+    if (has_prediction) {
+        node->SetPosition(predicted_pos);
+        node->SetRotation(predicted_rot);
+    }
+
+    runNodePrediction(node, deltatime, controls);
+    predicted_pos = node->GetPosition();
+    predicted_rot = node->GetRotation();
+    has_prediction = true;
+
+    PredictedInput input;
+    input.sequence = input_sequence;
+    input.controls = controls;
+    input.deltatime = deltatime;
+    input.pos = predicted_pos;
+    input.rot = predicted_rot;
+    predicted_inputs.Push(input);
+    if (predicted_inputs.Size() > MAX_PREDICTED_INPUTS) {
+        predicted_inputs.Erase(0);
+    }
+}
+
+void GameState::runNodePrediction(Urho3D::Node* node, float deltatime, Urho3D::Controls const& controls)
+{
+    Urho3D::PODVector<GameObject*> gameobjs;
+    node->GetDerivedComponents<GameObject>(gameobjs);
+    for (GameObject* gameobj : gameobjs) {
+        if (!gameobj->isSleeping()) {
+            gameobj->runPrediction(deltatime, controls);
+        }
+    }
 }
 
 }
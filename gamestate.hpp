@@ -1,15 +1,25 @@
 #ifndef GAMELIB_GAMESTATE_HPP
 #define GAMELIB_GAMESTATE_HPP
 
+#include "decalmanager.hpp"
+#include "inputstream.hpp"
+#include "networkstats.hpp"
 #include "scenerendererstate.hpp"
+#include "snapshotinterpolator.hpp"
 
+#include <Urho3D/Container/List.h>
+#include <Urho3D/Graphics/Drawable.h>
 #include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Input/Controls.h>
 #include <Urho3D/Scene/Scene.h>
 
+#include <set>
+
 namespace GameLib
 {
 
 class App;
+class GameObject;
 
 class GameState : public SceneRendererState
 {
@@ -21,25 +31,99 @@ public:
     void show() override;
     void hide() override;
 
-    // Called from App
-    void addDecalsRecursively(Urho3D::Node* node, Urho3D::Frustum const& frustum, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
+    // Called from App. Adds decal to geometry inside frustum, if
+    // the geometry belongs to a GameObject that receives decals.
+    void addDecals(Urho3D::Frustum const& frustum, Urho3D::Material* mat, Urho3D::Vector3 const& pos, Urho3D::Quaternion const& rot, float size, float aspect, float depth, Urho3D::Vector2 const& uv_begin, Urho3D::Vector2 const& uv_end);
+
+    // For statistics about decals
+    DecalManager const& getDecalManager() const;
+
+    // How many replicated GameObjects are still waiting for
+    // handleAddedToClient(). Use this to show progress of joining.
+    unsigned getNumPendingGameObjects() const;
+    // From zero to one. Total is not known beforehand, so this is
+    // the share of GameObjects received so far that have been added.
+    float getJoinProgress() const;
+
+    // Traffic of server connection
+    NetworkStats& getNetworkStats();
 
 private:
 
+    // Input that has been predicted, but not yet acknowledged by server,
+    // and where the controlled Node was after it had been applied.
+    struct PredictedInput
+    {
+        unsigned sequence;
+        Urho3D::Controls controls;
+        float deltatime;
+        Urho3D::Vector3 pos;
+        Urho3D::Quaternion rot;
+    };
+    typedef Urho3D::Vector<PredictedInput> PredictedInputs;
+
+    typedef Urho3D::List<Urho3D::WeakPtr<GameObject> > PendingGameObjects;
+
     unsigned controlled_node_id;
 
     float yaw, pitch;
     bool get_yaw_and_pitch_from_gameobject;
 
-    unsigned decals_total;
+    DecalManager decals;
+
+    NetworkStats network_stats;
+
+    // GameObjects that wait for handleAddedToClient(), and how many
+    // have been added. Counter is reset when there is nothing to add.
+    PendingGameObjects pending_gameobjs;
+    unsigned added_gameobjs;
+
+    // Smooths movement of Nodes that are not controlled by this client
+    Urho3D::SharedPtr<SnapshotInterpolator> interpolator;
+
+    // Nodes that server does not send updates of, so they
+    // are disabled instead of being left frozen in place.
+    std::set<unsigned> hidden_node_ids;
+
+    // Counts frames of input, so server can tell which one it applied
+    unsigned input_sequence;
+    InputSender input_sender;
+    PredictedInputs predicted_inputs;
+    // Where controlled Node is according to prediction. Replication
+    // moves it back to older server positions, so this is restored.
+    bool has_prediction;
+    Urho3D::Vector3 predicted_pos;
+    Urho3D::Quaternion predicted_rot;
+    // Latest state of controlled Node from server
+    bool prediction_ack_received;
+    unsigned acked_sequence;
+    Urho3D::Vector3 acked_pos;
+    Urho3D::Quaternion acked_rot;
+    // Used when finding geometry for decals
+    Urho3D::PODVector<Urho3D::Drawable*> decal_drawables_buf;
 
     void handleKeyDown(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleComponentAdded(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleSetControlledNode(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handlePredictionAck(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleServerInfo(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleRelevanceChanged(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleCustomNetworkEvent(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
 
-    unsigned reduceDecalsRecursively(Urho3D::Node* node);
+    // Calls handleAddedToClient() of pending GameObjects until time runs out
+    void addPendingGameObjects(float time_budget);
+    // Does not wait for time budget, so player can move immediately
+    void addControlledGameObjects();
+    void addGameObject(GameObject* gameobj);
+
+    // Moves controlled Node with controls of this frame. If server
+    // has acknowledged inputs since the previous frame and disagrees
+    // with prediction, then unacknowledged inputs are replayed first.
+    void runPrediction(Urho3D::Node* node, Urho3D::Controls const& controls, float deltatime);
+    // Runs prediction of the same GameObjects of Node that
+    // server runs for one input, in the same order.
+    void runNodePrediction(Urho3D::Node* node, float deltatime, Urho3D::Controls const& controls);
 };
 
 }
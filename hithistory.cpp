@@ -0,0 +1,159 @@
+#include "hithistory.hpp"
+
+#include <Urho3D/Math/MathDefs.h>
+
+#include <cassert>
+
+namespace GameLib
+{
+
+float const QUANTIZATION = 16;
+
+uint16_t const INVALID_HALF_SIZE = 0xffff;
+
+HitHistory::HitHistory() :
+    frames_capacity(0),
+    slots_capacity(0),
+    min_frame_interval(0),
+    newest_frame(0),
+    next_serial(1)
+{
+}
+
+void HitHistory::setCapacity(unsigned frames, unsigned slots, uint64_t min_frame_interval)
+{
+    frames_capacity = frames;
+    slots_capacity = slots;
+    this->min_frame_interval = min_frame_interval;
+
+    boxes.Resize(frames * slots);
+    frame_times.Resize(frames);
+    frame_serials.Resize(frames);
+    for (unsigned i = 0; i < frames; ++ i) {
+        frame_serials[i] = 0;
+    }
+    newest_frame = 0;
+
+    slot_first_serials.Resize(slots);
+    free_slots.Clear();
+    for (unsigned i = slots; i > 0; -- i) {
+        free_slots.Push(i - 1);
+    }
+}
+
+unsigned HitHistory::allocateSlot()
+{
+    if (free_slots.Empty()) {
+        return NO_SLOT;
+    }
+    unsigned slot = free_slots.Back();
+    free_slots.Pop();
+    slot_first_serials[slot] = next_serial;
+    return slot;
+}
+
+void HitHistory::releaseSlot(unsigned slot)
+{
+    assert(slot < slots_capacity);
+    free_slots.Push(slot);
+}
+
+void HitHistory::beginFrame(uint64_t time)
+{
+    if (!frames_capacity) {
+        return;
+    }
+
+    // If frames are begun often, then keep replacing the newest
+    // one until it is far enough from the frame before it.
+    unsigned previous_frame = (newest_frame + frames_capacity - 1) % frames_capacity;
+    bool replace = frames_capacity > 1 && frame_serials[newest_frame] && frame_serials[previous_frame] && frame_times[newest_frame] < frame_times[previous_frame] + min_frame_interval;
+    if (!replace) {
+        newest_frame = (newest_frame + 1) % frames_capacity;
+    }
+    frame_times[newest_frame] = time;
+    frame_serials[newest_frame] = next_serial ++;
+
+    // Mark all boxes invalid
+    QuantizedBox* frame_boxes = &boxes[newest_frame * slots_capacity];
+    for (unsigned i = 0; i < slots_capacity; ++ i) {
+        frame_boxes[i].half_size[0] = INVALID_HALF_SIZE;
+    }
+}
+
+void HitHistory::setBounds(unsigned slot, Urho3D::BoundingBox const& bounds)
+{
+    assert(slot < slots_capacity);
+    if (!frames_capacity || !bounds.Defined()) {
+        return;
+    }
+    QuantizedBox& box = boxes[newest_frame * slots_capacity + slot];
+    Urho3D::Vector3 center = bounds.Center();
+    Urho3D::Vector3 half_size = bounds.HalfSize();
+    for (unsigned i = 0; i < 3; ++ i) {
+        box.center[i] = center.Data()[i];
+        box.half_size[i] = uint16_t(Urho3D::Min(Urho3D::Ceil(half_size.Data()[i] * QUANTIZATION), float(INVALID_HALF_SIZE - 1)));
+    }
+}
+
+bool HitHistory::getBounds(Urho3D::BoundingBox& result, unsigned slot, double time) const
+{
+    assert(slot < slots_capacity);
+
+    // Go from the newest frame towards older ones, until a frame
+    // that is not newer than the requested time is found.
+    QuantizedBox const* newer = nullptr;
+    uint64_t newer_time = 0;
+    for (unsigned age = 0; age < frames_capacity; ++ age) {
+        unsigned frame = (newest_frame + frames_capacity - age) % frames_capacity;
+        QuantizedBox const* box = getBox(frame, slot);
+        if (!box) {
+            break;
+        }
+        uint64_t frame_time = frame_times[frame];
+        if (frame_time <= time) {
+            // If there is a newer frame, then interpolate between them
+            if (newer && newer_time > frame_time) {
+                float t = float((time - frame_time) / (newer_time - frame_time));
+                result = Urho3D::BoundingBox(
+                    dequantize(*box).min_.Lerp(dequantize(*newer).min_, t),
+                    dequantize(*box).max_.Lerp(dequantize(*newer).max_, t)
+                );
+            } else {
+                result = dequantize(*box);
+            }
+            return true;
+        }
+        newer = box;
+        newer_time = frame_time;
+    }
+
+    // Requested time is older than history
+    if (newer) {
+        result = dequantize(*newer);
+        return true;
+    }
+    return false;
+}
+
+HitHistory::QuantizedBox const* HitHistory::getBox(unsigned frame, unsigned slot) const
+{
+    uint64_t serial = frame_serials[frame];
+    if (!serial || serial < slot_first_serials[slot]) {
+        return nullptr;
+    }
+    QuantizedBox const* box = &boxes[frame * slots_capacity + slot];
+    if (box->half_size[0] == INVALID_HALF_SIZE) {
+        return nullptr;
+    }
+    return box;
+}
+
+Urho3D::BoundingBox HitHistory::dequantize(QuantizedBox const& box)
+{
+    Urho3D::Vector3 center(box.center[0], box.center[1], box.center[2]);
+    Urho3D::Vector3 half_size = Urho3D::Vector3(box.half_size[0], box.half_size[1], box.half_size[2]) / QUANTIZATION;
+    return Urho3D::BoundingBox(center - half_size, center + half_size);
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef GAMELIB_HITHISTORY_HPP
+#define GAMELIB_HITHISTORY_HPP
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include <cstdint>
+
+namespace GameLib
+{
+
+// Ring buffer of past bounding boxes, used for rewinding hitscans. Every
+// frame has one box per slot, and all memory is allocated when capacity is
+// set. Centers of boxes are stored as they are, so boxes can be anywhere.
+// Half sizes are quantized to 1/16 units and rounded outwards, so boxes never
+// shrink. Half sizes are limited to about 4000 units.
+class HitHistory
+{
+
+public:
+
+    static unsigned const NO_SLOT = 0xffffffff;
+
+    HitHistory();
+
+    // Allocates room for given amount of frames and slots. Old history is
+    // discarded. Frames are kept at least given amount of milliseconds apart,
+    // so history covers at least frames times that much time, however often
+    // frames are begun.
+    void setCapacity(unsigned frames, unsigned slots, uint64_t min_frame_interval = 0);
+
+    // Returns NO_SLOT if all slots are in use. A new slot
+    // has no history from before it was allocated.
+    unsigned allocateSlot();
+    void releaseSlot(unsigned slot);
+
+    // Starts a new frame, overwriting the oldest one if history is full. If
+    // the newest frame is less than the minimum interval newer than the one
+    // before it, then that is overwritten instead. Time is in milliseconds.
+    // Boxes of the new frame are undefined until they are set.
+    void beginFrame(uint64_t time);
+    void setBounds(unsigned slot, Urho3D::BoundingBox const& bounds);
+
+    // Returns bounds of slot at given time in milliseconds, interpolated between
+    // frames. Times older than history are clamped to the oldest frame. Returns
+    // false if slot has no bounds recorded at that time.
+    bool getBounds(Urho3D::BoundingBox& result, unsigned slot, double time) const;
+
+private:
+
+    // Bounds are invalid if half size is INVALID_HALF_SIZE
+    struct QuantizedBox
+    {
+        float center[3];
+        uint16_t half_size[3];
+    };
+
+    typedef Urho3D::PODVector<QuantizedBox> Boxes;
+    typedef Urho3D::PODVector<uint64_t> Numbers;
+    typedef Urho3D::PODVector<unsigned> Slots;
+
+    unsigned frames_capacity;
+    unsigned slots_capacity;
+    uint64_t min_frame_interval;
+
+    // Boxes of frame are stored contiguously
+    Boxes boxes;
+    Numbers frame_times;
+    // Serial numbers of frames. Zero means the frame is not used.
+    Numbers frame_serials;
+    unsigned newest_frame;
+    uint64_t next_serial;
+
+    // Serial number of the first frame recorded for every slot
+    Numbers slot_first_serials;
+    Slots free_slots;
+
+    QuantizedBox const* getBox(unsigned frame, unsigned slot) const;
+    static Urho3D::BoundingBox dequantize(QuantizedBox const& box);
+};
+
+}
+
+#endif
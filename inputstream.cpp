@@ -0,0 +1,518 @@
+#include "inputstream.hpp"
+
+#include "network.hpp"
+
+#include <Urho3D/IO/VectorBuffer.h>
+
+#include <cmath>
+
+namespace GameLib
+{
+
+// Yaw and pitch are sent as 16 bit angles
+static uint16_t encodeAngle(float angle)
+{
+    angle = std::fmod(angle, 360.0f);
+    if (angle < 0) {
+        angle += 360;
+    }
+    return uint16_t(unsigned(Urho3D::Round(angle / 360 * 65536)) & 0xffff);
+}
+
+static float decodeYaw(uint16_t encoded)
+{
+    return encoded * 360.0f / 65536;
+}
+
+// Pitch is around zero
+static float decodePitch(uint16_t encoded)
+{
+    float angle = decodeYaw(encoded);
+    if (angle >= 180) {
+        angle -= 360;
+    }
+    return angle;
+}
+
+// Longer frames are sent as this long
+float const MAX_DELTATIME = 0.25f;
+
+// Deltatime is sent in tenths of milliseconds
+static uint16_t encodeDeltatime(float deltatime)
+{
+    return uint16_t(Urho3D::Clamp(Urho3D::RoundToInt(Urho3D::Min(deltatime, MAX_DELTATIME) * 10000), 0, 0xffff));
+}
+
+static float decodeDeltatime(uint16_t encoded)
+{
+    return encoded / 10000.0f;
+}
+
+// Writes values of any bit length to the end of a buffer, lowest bits first
+class BitWriter
+{
+
+public:
+
+    inline BitWriter(Urho3D::VectorBuffer& buf) :
+        buf(buf),
+        pending(0),
+        pending_bits(0)
+    {
+    }
+
+    inline void write(unsigned value, unsigned bits)
+    {
+        pending |= uint64_t(value & ((uint64_t(1) << bits) - 1)) << pending_bits;
+        pending_bits += bits;
+        while (pending_bits >= 8) {
+            buf.WriteUByte(uint8_t(pending));
+            pending >>= 8;
+            pending_bits -= 8;
+        }
+    }
+
+    // Writes the last partial byte, padded with zeros
+    inline void flush()
+    {
+        if (pending_bits) {
+            buf.WriteUByte(uint8_t(pending));
+            pending = 0;
+            pending_bits = 0;
+        }
+    }
+
+private:
+
+    Urho3D::VectorBuffer& buf;
+    uint64_t pending;
+    unsigned pending_bits;
+};
+
+// Reads what BitWriter wrote. Bytes are taken from the buffer
+// as they are needed, so bytes after the bits can be read normally.
+class BitReader
+{
+
+public:
+
+    inline BitReader(Urho3D::MemoryBuffer& buf) :
+        buf(buf),
+        pending(0),
+        pending_bits(0)
+    {
+    }
+
+    // Returns false if the buffer ends before the value does
+    inline bool read(unsigned& result, unsigned bits)
+    {
+        while (pending_bits < bits) {
+            if (buf.IsEof()) {
+                return false;
+            }
+            pending |= uint64_t(buf.ReadUByte()) << pending_bits;
+            pending_bits += 8;
+        }
+        result = unsigned(pending & ((uint64_t(1) << bits) - 1));
+        pending >>= bits;
+        pending_bits -= bits;
+        return true;
+    }
+
+private:
+
+    Urho3D::MemoryBuffer& buf;
+    uint64_t pending;
+    unsigned pending_bits;
+};
+
+// Numbers are written seven bits at a time, each followed by
+// a bit that tells if there are more. This can write all 32 bits.
+static void writeVarUInt(BitWriter& writer, unsigned value)
+{
+    while (value >= 0x80) {
+        writer.write(value, 7);
+        writer.write(1, 1);
+        value >>= 7;
+    }
+    writer.write(value, 7);
+    writer.write(0, 1);
+}
+
+static bool readVarUInt(unsigned& result, BitReader& reader)
+{
+    result = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        unsigned bits;
+        unsigned more;
+        if (!reader.read(bits, 7) || !reader.read(more, 1)) {
+            return false;
+        }
+        result |= bits << shift;
+        if (!more) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Buttons are sent as the bits that changed. Unchanged buttons take one
+// bit, and changes eight bits at a time, each followed by a bit that
+// tells if there are more.
+static void writeButtons(BitWriter& writer, unsigned buttons, unsigned prev)
+{
+    unsigned changed = buttons ^ prev;
+    writer.write(changed ? 1 : 0, 1);
+    while (changed) {
+        writer.write(changed, 8);
+        changed >>= 8;
+        writer.write(changed ? 1 : 0, 1);
+    }
+}
+
+static bool readButtons(unsigned& result, BitReader& reader, unsigned prev)
+{
+    unsigned more;
+    if (!reader.read(more, 1)) {
+        return false;
+    }
+    unsigned changed = 0;
+    for (unsigned shift = 0; more; shift += 8) {
+        unsigned bits;
+        if (shift >= 32 || !reader.read(bits, 8) || !reader.read(more, 1)) {
+            return false;
+        }
+        changed |= bits << shift;
+    }
+    result = prev ^ changed;
+    return true;
+}
+
+// Sizes of differences, after the two bits that tell which one is used
+unsigned const DIFFERENCE_BITS[4] = { 4, 8, 12, 16 };
+
+// Sixteen bit values are sent as differences to previous values. Zero
+// takes one bit. Others are zigzag encoded, so small negative differences
+// are small too, and take the fewest of 4, 8, 12 or 16 bits that fit.
+static void writeDifference(BitWriter& writer, uint16_t value, uint16_t prev)
+{
+    unsigned diff = uint16_t(value - prev);
+    if (!diff) {
+        writer.write(0, 1);
+        return;
+    }
+    writer.write(1, 1);
+    // Differences wrap around, so the shorter way is used.
+    // Zero is not possible, so it is not given a code.
+    unsigned zigzag = diff < 0x8000 ? diff * 2 - 2 : (0x10000 - diff) * 2 - 1;
+    unsigned size = 0;
+    while (zigzag >> DIFFERENCE_BITS[size]) {
+        ++ size;
+    }
+    writer.write(size, 2);
+    writer.write(zigzag, DIFFERENCE_BITS[size]);
+}
+
+static bool readDifference(uint16_t& result, BitReader& reader, uint16_t prev)
+{
+    unsigned changed;
+    if (!reader.read(changed, 1)) {
+        return false;
+    }
+    if (!changed) {
+        result = prev;
+        return true;
+    }
+    unsigned size;
+    unsigned zigzag;
+    if (!reader.read(size, 2) || !reader.read(zigzag, DIFFERENCE_BITS[size])) {
+        return false;
+    }
+    unsigned diff = zigzag % 2 == 0 ? zigzag / 2 + 1 : 0x10000 - (zigzag + 1) / 2;
+    result = uint16_t(prev + diff);
+    return true;
+}
+
+InputSender::InputSender() :
+    send_interval(1.0f / 30),
+    send_timer(0),
+    interpolation_delay(0),
+    extra_data_version(0),
+    extra_data_sends(0),
+    unsent_count(0)
+{
+}
+
+void InputSender::setSendRate(unsigned send_rate)
+{
+    send_interval = 1.0f / Urho3D::Max(send_rate, 1u);
+}
+
+void InputSender::quantize(Urho3D::Controls& controls)
+{
+    controls.yaw_ = decodeYaw(encodeAngle(controls.yaw_));
+    controls.pitch_ = decodePitch(encodeAngle(controls.pitch_));
+}
+
+float InputSender::quantizeDeltatime(float deltatime)
+{
+    return decodeDeltatime(encodeDeltatime(deltatime));
+}
+
+void InputSender::addInput(Urho3D::Controls const& controls, unsigned sequence, float deltatime)
+{
+    // Inputs that have been sent are only repeated, so the oldest of them
+    // can be dropped. If none has been sent, then the oldest input is merged
+    // into the next one, so server still gets all buttons and time. Merged
+    // input has the newer sequence, so acknowledgement covers both.
+    if (inputs.Size() >= MAX_INPUTS) {
+        if (!sent_counts.Empty()) {
+            inputs.Erase(0);
+            if (-- sent_counts[0] == 0) {
+                sent_counts.Erase(0);
+            }
+        } else {
+            Input& next = inputs[1];
+            next.buttons |= inputs[0].buttons;
+            next.deltatime = uint16_t(Urho3D::Min(unsigned(next.deltatime) + inputs[0].deltatime, unsigned(encodeDeltatime(MAX_DELTATIME))));
+            inputs.Erase(0);
+            -- unsent_count;
+        }
+    }
+
+    if (controls.extraData_ != extra_data) {
+        extra_data = controls.extraData_;
+        ++ extra_data_version;
+        extra_data_sends = REDUNDANCY + 1;
+    }
+
+    Input input;
+    input.sequence = sequence;
+    input.buttons = controls.buttons_;
+    input.yaw = encodeAngle(controls.yaw_);
+    input.pitch = encodeAngle(controls.pitch_);
+    input.deltatime = encodeDeltatime(deltatime);
+    inputs.Push(input);
+    ++ unsent_count;
+}
+
+void InputSender::setInterpolationDelay(float interpolation_delay)
+{
+    this->interpolation_delay = interpolation_delay;
+}
+
+unsigned InputSender::update(Urho3D::Connection* conn, float deltatime)
+{
+    send_timer += deltatime;
+    if (send_timer < send_interval || !unsent_count || !conn) {
+        return 0;
+    }
+    // Do not try to catch up after a long frame
+    send_timer = Urho3D::Min(send_timer - send_interval, send_interval);
+
+    Urho3D::VectorBuffer buf;
+    unsigned newest_sequence = inputs.Back().sequence;
+    buf.WriteUInt(newest_sequence);
+    buf.WriteUShort(uint16_t(Urho3D::Clamp(Urho3D::RoundToInt(interpolation_delay * 1000), 0, 0xffff)));
+
+    // There are never more than MAX_INPUTS, so count fits in six bits
+    BitWriter writer(buf);
+    writer.write(inputs.Size() - 1, 6);
+    bool sends_extra_data = extra_data_sends > 0;
+    writer.write(extra_data_version, 8);
+    writer.write(sends_extra_data ? 1 : 0, 1);
+
+    // Inputs from older to newer, each compared to the one before it. The
+    // oldest one tells how much older than the newest one it is, and is
+    // compared to zero. Sequences of others usually grow by one.
+    Input prev;
+    prev.sequence = 0;
+    prev.buttons = 0;
+    prev.yaw = 0;
+    prev.pitch = 0;
+    prev.deltatime = 0;
+    for (unsigned i = 0; i < inputs.Size(); ++ i) {
+        Input const& input = inputs[i];
+        if (i == 0) {
+            writeVarUInt(writer, newest_sequence - input.sequence);
+        } else if (input.sequence == prev.sequence + 1) {
+            writer.write(1, 1);
+        } else {
+            // Merged inputs leave gaps
+            writer.write(0, 1);
+            writeVarUInt(writer, input.sequence - prev.sequence - 2);
+        }
+        writeButtons(writer, input.buttons, prev.buttons);
+        writeDifference(writer, input.yaw, prev.yaw);
+        writeDifference(writer, input.pitch, prev.pitch);
+        writeDifference(writer, input.deltatime, prev.deltatime);
+        prev = input;
+    }
+    writer.flush();
+
+    // Extra data fills the rest of the message
+    if (sends_extra_data) {
+        buf.WriteVariantMap(extra_data);
+        -- extra_data_sends;
+    }
+
+    conn->SendMessage(MSG_INPUT, false, false, buf);
+
+    // Repeat inputs of this message in the next ones
+    sent_counts.Push(unsent_count);
+    unsent_count = 0;
+    if (sent_counts.Size() > REDUNDANCY) {
+        inputs.Erase(0, sent_counts[0]);
+        sent_counts.Erase(0);
+    }
+
+    return buf.GetSize();
+}
+
+InputReceiver::InputReceiver() :
+    interpolation_delay(0),
+    extra_data_version(0),
+    has_input(false),
+    dropped_buttons(0)
+{
+    latest.sequence = 0;
+    latest.deltatime = 0;
+}
+
+bool InputReceiver::receive(Urho3D::MemoryBuffer& buf)
+{
+    if (buf.GetSize() < 6) {
+        return false;
+    }
+    unsigned newest_sequence = buf.ReadUInt();
+    float new_interpolation_delay = buf.ReadUShort() / 1000.0f;
+
+    // Messages are not ordered, so ignore old ones
+    if (has_input && int(newest_sequence - latest.sequence) <= 0) {
+        return true;
+    }
+
+    BitReader reader(buf);
+    unsigned inputs_count;
+    unsigned new_extra_data_version;
+    unsigned has_extra_data;
+    if (!reader.read(inputs_count, 6) || !reader.read(new_extra_data_version, 8) || !reader.read(has_extra_data, 1)) {
+        return false;
+    }
+    ++ inputs_count;
+
+    Inputs received;
+    received.Resize(inputs_count);
+    unsigned sequence = 0;
+    unsigned buttons = 0;
+    uint16_t yaw = 0;
+    uint16_t pitch = 0;
+    uint16_t deltatime = 0;
+    for (unsigned i = 0; i < inputs_count; ++ i) {
+        if (i == 0) {
+            unsigned age;
+            if (!readVarUInt(age, reader)) {
+                return false;
+            }
+            sequence = newest_sequence - age;
+        } else {
+            unsigned consecutive;
+            if (!reader.read(consecutive, 1)) {
+                return false;
+            }
+            unsigned gap = 0;
+            if (!consecutive && !readVarUInt(gap, reader)) {
+                return false;
+            }
+            sequence += consecutive ? 1 : gap + 2;
+        }
+        // Sequences must not go past the newest one
+        if (int(newest_sequence - sequence) < 0) {
+            return false;
+        }
+        if (!readButtons(buttons, reader, buttons) || !readDifference(yaw, reader, yaw) || !readDifference(pitch, reader, pitch) || !readDifference(deltatime, reader, deltatime)) {
+            return false;
+        }
+        Input& input = received[i];
+        input.sequence = sequence;
+        input.controls.buttons_ = buttons;
+        input.controls.yaw_ = decodeYaw(yaw);
+        input.controls.pitch_ = decodePitch(pitch);
+        input.deltatime = decodeDeltatime(deltatime);
+    }
+    if (sequence != newest_sequence) {
+        return false;
+    }
+
+    // Extra data is only read if its version is new
+    bool reads_extra_data = has_extra_data && uint8_t(new_extra_data_version) != extra_data_version;
+    Urho3D::VariantMap new_extra_data;
+    if (reads_extra_data) {
+        new_extra_data = buf.ReadVariantMap();
+    }
+    if (!buf.IsEof() && (reads_extra_data || !has_extra_data)) {
+        return false;
+    }
+
+    // Queue inputs that have not been received before, from older to newer
+    for (Input const& input : received) {
+        if (!has_input || int(input.sequence - latest.sequence) > 0) {
+            queued.Push(input);
+        }
+    }
+    while (queued.Size() > MAX_QUEUED_INPUTS) {
+        dropped_buttons |= queued[0].controls.buttons_;
+        queued.Erase(0);
+    }
+
+    has_input = true;
+    latest = received.Back();
+    interpolation_delay = new_interpolation_delay;
+    if (reads_extra_data) {
+        extra_data = new_extra_data;
+        extra_data_version = uint8_t(new_extra_data_version);
+    }
+    return true;
+}
+
+void InputReceiver::popControls(Urho3D::Controls& result)
+{
+    // Keys stay down until an input releases them
+    unsigned buttons = queued.Empty() ? latest.controls.buttons_ : 0;
+    for (Input const& input : queued) {
+        buttons |= input.controls.buttons_;
+    }
+    result.buttons_ = buttons | dropped_buttons;
+    result.yaw_ = latest.controls.yaw_;
+    result.pitch_ = latest.controls.pitch_;
+    result.extraData_ = extra_data;
+    if (has_input) {
+        result.extraData_[CTRL_EXTRA_SEQUENCE] = latest.sequence;
+    }
+    queued.Clear();
+    dropped_buttons = 0;
+}
+
+bool InputReceiver::popInput(Urho3D::Controls& result, float& result_deltatime)
+{
+    if (queued.Empty()) {
+        return false;
+    }
+    Input const& input = queued.Front();
+    result = input.controls;
+    result.extraData_ = extra_data;
+    // Short presses of dropped inputs are not lost
+    result.buttons_ |= dropped_buttons;
+    result.extraData_[CTRL_EXTRA_SEQUENCE] = input.sequence;
+    result_deltatime = input.deltatime;
+    queued.Erase(0);
+    dropped_buttons = 0;
+    return true;
+}
+
+float InputReceiver::getInterpolationDelay() const
+{
+    return interpolation_delay;
+}
+
+}
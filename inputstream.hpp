@@ -0,0 +1,144 @@
+#ifndef GAMELIB_INPUTSTREAM_HPP
+#define GAMELIB_INPUTSTREAM_HPP
+
+#include <Urho3D/Input/Controls.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Network/Connection.h>
+
+#include <cstdint>
+
+namespace GameLib
+{
+
+// Inputs are sent from client to server in compact, unreliable messages.
+// Every frame of client is one input, with its own buttons, aim and
+// deltatime, so server can apply inputs one by one like client predicted
+// them. Every message also repeats the inputs of a few previous messages, so
+// a lost message does not lose any input. Inputs are bit packed, and each is
+// sent as a difference to the one before it, so unchanged buttons, aim and
+// deltatime take one bit each. Extra data is treated as state that changes
+// rarely. It is only sent in the few messages after it changes, and the
+// server gives the newest extra data it has with every input.
+class InputSender
+{
+
+public:
+
+    InputSender();
+
+    // How many messages are sent per second
+    void setSendRate(unsigned send_rate);
+
+    // Rounds yaw, pitch and deltatime like they are rounded when sent,
+    // so client can predict with exactly what server will get. Deltatime
+    // is also limited, so one input cannot cover a long frame.
+    static void quantize(Urho3D::Controls& controls);
+    static float quantizeDeltatime(float deltatime);
+
+    // Adds input of one frame
+    void addInput(Urho3D::Controls const& controls, unsigned sequence, float deltatime);
+
+    // How many seconds behind the newest network update client shows
+    // other Nodes. Server adds this to rewind of lag compensation.
+    void setInterpolationDelay(float interpolation_delay);
+
+    // Sends inputs if it is time for it. Returns
+    // size of the sent message, or zero if none.
+    unsigned update(Urho3D::Connection* conn, float deltatime);
+
+private:
+
+    // How many previous messages are repeated in every message
+    static unsigned const REDUNDANCY = 3;
+    // Limits size of messages if frames are much shorter than send interval.
+    // When exceeded, the oldest repeated inputs are dropped, or if there are
+    // none, the oldest unsent inputs are merged.
+    static unsigned const MAX_INPUTS = 32;
+
+    // Aim and deltatime are stored like they are sent
+    struct Input
+    {
+        unsigned sequence;
+        unsigned buttons;
+        uint16_t yaw;
+        uint16_t pitch;
+        uint16_t deltatime;
+    };
+    typedef Urho3D::PODVector<Input> Inputs;
+
+    float send_interval;
+    float send_timer;
+
+    float interpolation_delay;
+
+    // Newest extra data. When it changes, its version is increased,
+    // and it is sent in the next few messages.
+    Urho3D::VariantMap extra_data;
+    uint8_t extra_data_version;
+    unsigned extra_data_sends;
+
+    // Inputs of previous messages and then inputs that
+    // have not been sent yet, from oldest to newest.
+    Inputs inputs;
+    // How many inputs each previous message added, from oldest to newest
+    Urho3D::PODVector<unsigned> sent_counts;
+    unsigned unsent_count;
+};
+
+// Server side of InputSender
+class InputReceiver
+{
+
+public:
+
+    InputReceiver();
+
+    // Returns false if the message was malformed
+    bool receive(Urho3D::MemoryBuffer& buf);
+
+    // Gives Controls for one tick. They have the newest aim and extra data,
+    // and buttons of all inputs that have been received since the previous
+    // call. Sequence of the newest input is in extra data.
+    void popControls(Urho3D::Controls& result);
+
+    // Gives the oldest input that has not been given yet, with its sequence
+    // in extra data. Returns false if there is none. Use this instead of
+    // popControls() when inputs are applied one by one.
+    bool popInput(Urho3D::Controls& result, float& result_deltatime);
+
+    // Newest interpolation delay of client, in seconds
+    float getInterpolationDelay() const;
+
+private:
+
+    // Limits memory if inputs are not popped
+    static unsigned const MAX_QUEUED_INPUTS = 64;
+
+    // Controls do not have extra data, because it is kept separately
+    struct Input
+    {
+        unsigned sequence;
+        Urho3D::Controls controls;
+        float deltatime;
+    };
+    typedef Urho3D::Vector<Input> Inputs;
+
+    float interpolation_delay;
+
+    Urho3D::VariantMap extra_data;
+    uint8_t extra_data_version;
+
+    bool has_input;
+    // Newest received input
+    Input latest;
+
+    // Inputs that have been received, but not given
+    // to a tick yet, from oldest to newest.
+    Inputs queued;
+    // Buttons of inputs that were dropped from the queue
+    unsigned dropped_buttons;
+};
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "lagcompensation.hpp"
+
+#include "gameobject.hpp"
+#include "gameobjectregistry.hpp"
+
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Node.h>
+
+namespace GameLib
+{
+
+LagCompensation::LagCompensation(GameObjectRegistry* registry) :
+    registry(registry)
+{
+}
+
+void LagCompensation::setCapacity(float length, float interval, unsigned gameobjs)
+{
+    // Release slots, because allocating capacity forgets them
+    unsigned compensated_count = registry->getNumLagCompensatedGameObjects();
+    for (unsigned i = 0; i < compensated_count; ++ i) {
+        GameObject* gameobj = registry->getLagCompensatedGameObject(i);
+        if (gameobj) {
+            gameobj->hit_history_slot = HitHistory::NO_SLOT;
+        }
+    }
+
+    // Timers might round ticks to whole milliseconds, so
+    // the interval is rounded down, and frames count up.
+    uint64_t interval_ms = Urho3D::Max(uint64_t(interval * 1000), uint64_t(1));
+    unsigned frames = unsigned(Urho3D::Ceil(length * 1000 / interval_ms)) + 1;
+    hit_history.setCapacity(frames, gameobjs, interval_ms);
+
+    for (unsigned i = 0; i < compensated_count; ++ i) {
+        GameObject* gameobj = registry->getLagCompensatedGameObject(i);
+        if (gameobj) {
+            start(gameobj);
+        }
+    }
+}
+
+void LagCompensation::record()
+{
+    hit_history.beginFrame(registry->getTimers().getTime());
+
+    unsigned compensated_count = registry->getNumLagCompensatedGameObjects();
+    for (unsigned i = 0; i < compensated_count; ++ i) {
+        GameObject* gameobj = registry->getLagCompensatedGameObject(i);
+        if (!gameobj || gameobj->hit_history_slot == HitHistory::NO_SLOT) {
+            continue;
+        }
+        // Use the bounds of all geometry in the Node and its children
+        Urho3D::BoundingBox bounds;
+        gameobj->GetNode()->GetDerivedComponents<Urho3D::Drawable>(drawables_buf, true);
+        for (Urho3D::Drawable* drawable : drawables_buf) {
+            if (drawable->IsEnabledEffective() && (drawable->GetDrawableFlags() & Urho3D::DRAWABLE_GEOMETRY)) {
+                bounds.Merge(drawable->GetWorldBoundingBox());
+            }
+        }
+        hit_history.setBounds(gameobj->hit_history_slot, bounds);
+    }
+}
+
+bool LagCompensation::getPastBounds(Urho3D::BoundingBox& result, GameObject const* gameobj, float rewind) const
+{
+    if (gameobj->hit_history_slot == HitHistory::NO_SLOT) {
+        return false;
+    }
+    double time = double(registry->getTimers().getTime()) - rewind * 1000.0;
+    return hit_history.getBounds(result, gameobj->hit_history_slot, time);
+}
+
+void LagCompensation::setInterpolationDelay(Urho3D::Connection* conn, float delay)
+{
+    if (delay > 0) {
+        interpolation_delays[conn] = delay;
+    } else {
+        interpolation_delays.Erase(conn);
+    }
+}
+
+float LagCompensation::getInterpolationDelay(Urho3D::Connection* conn) const
+{
+    InterpolationDelays::ConstIterator delays_find = interpolation_delays.Find(conn);
+    if (delays_find == interpolation_delays.End()) {
+        return 0;
+    }
+    return delays_find->second_;
+}
+
+void LagCompensation::start(GameObject* gameobj)
+{
+    assert(gameobj->hit_history_slot == HitHistory::NO_SLOT);
+    gameobj->hit_history_slot = hit_history.allocateSlot();
+    if (gameobj->hit_history_slot == HitHistory::NO_SLOT) {
+        URHO3D_LOGWARNINGF("Too many lag compensated GameObjects, %s is not compensated!", gameobj->GetTypeName().CString());
+    }
+}
+
+void LagCompensation::stop(GameObject* gameobj)
+{
+    if (gameobj->hit_history_slot != HitHistory::NO_SLOT) {
+        hit_history.releaseSlot(gameobj->hit_history_slot);
+        gameobj->hit_history_slot = HitHistory::NO_SLOT;
+    }
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef GAMELIB_LAGCOMPENSATION_HPP
+#define GAMELIB_LAGCOMPENSATION_HPP
+
+#include "hithistory.hpp"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Network/Connection.h>
+
+namespace GameLib
+{
+
+class GameObject;
+class GameObjectRegistry;
+
+// Remembers past bounds of lag compensated GameObjects, and how far behind
+// the server each client shows them, so hitscans can be rewound to what the
+// shooter saw. GameObjectRegistry keeps the list of lag compensated
+// GameObjects, and starts and stops their history when the list changes.
+class LagCompensation
+{
+
+public:
+
+    LagCompensation(GameObjectRegistry* registry);
+
+    // Allocates history for given amount of lag compensated GameObjects, over
+    // given amount of seconds. Bounds are recorded at most once per interval,
+    // which should be the tick length, or the shortest expected frame time
+    // with variable timestep. Existing history is discarded.
+    void setCapacity(float length, float interval, unsigned gameobjs);
+
+    // Records current bounds of lag compensated GameObjects. This
+    // is called by ServerState after every tick.
+    void record();
+
+    // Returns bounds of lag compensated GameObject from given amount of
+    // seconds ago. Returns false if GameObject has no such history.
+    bool getPastBounds(Urho3D::BoundingBox& result, GameObject const* gameobj, float rewind) const;
+
+    // How many seconds behind the server clients show other Nodes. This is
+    // set by ServerState from inputs of clients. Zero forgets the Connection.
+    void setInterpolationDelay(Urho3D::Connection* conn, float delay);
+    float getInterpolationDelay(Urho3D::Connection* conn) const;
+
+    // These are called by GameObjectRegistry
+    void start(GameObject* gameobj);
+    void stop(GameObject* gameobj);
+
+private:
+
+    typedef Urho3D::HashMap<Urho3D::Connection*, float> InterpolationDelays;
+
+    GameObjectRegistry* registry;
+
+    HitHistory hit_history;
+    InterpolationDelays interpolation_delays;
+    // Used when calculating bounds of GameObjects
+    Urho3D::PODVector<Urho3D::Drawable*> drawables_buf;
+};
+
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include "loadgenerator.hpp"
+
+#include "app.hpp"
+#include "network.hpp"
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Network/NetworkEvents.h>
+
+#include <cmath>
+
+namespace GameLib
+{
+
+// How many clients start connecting per frame. This
+// way the server is not flooded by all of them at once.
+unsigned const CONNECTS_PER_FRAME = 16;
+
+LoadGenerator::LoadGenerator(App* app, Urho3D::Context* context, ServerState* server, unsigned clients_count, float duration) :
+    Urho3D::Object(context),
+    app(app),
+    server(server),
+    port(server->getPort()),
+    clients(clients_count),
+    clients_connecting(0),
+    duration(duration),
+    time(0),
+    sample_timer(0),
+    bandwidth_samples(0),
+    bytes_in_sum(0),
+    bytes_out_sum(0)
+{
+    tick_stats.ticks = 0;
+    tick_stats.total = 0;
+    tick_stats.max = 0;
+
+    for (Client& client : clients) {
+        client.connect_latency = -1;
+        client.failed = false;
+        client.input_sequence = 0;
+    }
+
+    assert(port);
+
+    // Connections of synthetic clients check remote events from the
+    // whitelist of the subsystem, so client events are allowed there.
+    Urho3D::Network* network = GetSubsystem<Urho3D::Network>();
+    network->RegisterRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE);
+    Urho3D::Vector<Urho3D::StringHash> network_events;
+    app->getClientNetworkEvents(network_events);
+    for (auto network_event : network_events) {
+        network->RegisterRemoteEvent(network_event);
+    }
+
+    SubscribeToEvent(Urho3D::E_UPDATE, URHO3D_HANDLER(LoadGenerator, handleUpdate));
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for (Client& client : clients) {
+        if (client.network) {
+            client.network->Disconnect();
+        }
+    }
+}
+
+void LoadGenerator::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    float deltatime = event_data[Urho3D::Update::P_TIMESTEP].GetFloat();
+
+    connectMoreClients();
+
+    for (unsigned i = 0; i < clients.Size(); ++ i) {
+        sendSyntheticControls(i, deltatime);
+    }
+
+    // Collect statistics
+    if (server) {
+        ServerState::TickStats new_tick_stats = server->popTickStats();
+        tick_stats.ticks += new_tick_stats.ticks;
+        tick_stats.total += new_tick_stats.total;
+        tick_stats.max = Urho3D::Max(tick_stats.max, new_tick_stats.max);
+    }
+    sample_timer += deltatime;
+    if (sample_timer >= 1) {
+        sample_timer -= 1;
+        sampleBandwidth();
+    }
+
+    time += deltatime;
+    if (time >= duration) {
+        UnsubscribeFromEvent(Urho3D::E_UPDATE);
+        printReport();
+        app->stop();
+    }
+}
+
+void LoadGenerator::handleServerConnected(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+    (void)event_data;
+
+    Client* client = getClient(static_cast<Urho3D::Network*>(GetEventSender()));
+    if (client && client->connect_latency < 0) {
+        client->connect_latency = std::chrono::duration<float>(std::chrono::steady_clock::now() - client->connect_began).count();
+    }
+}
+
+void LoadGenerator::handleConnectFailed(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+    (void)event_data;
+
+    Client* client = getClient(static_cast<Urho3D::Network*>(GetEventSender()));
+    if (client) {
+        client->failed = true;
+    }
+}
+
+void LoadGenerator::connectMoreClients()
+{
+    unsigned connects_left = CONNECTS_PER_FRAME;
+    while (connects_left > 0 && clients_connecting < clients.Size()) {
+        Client& client = clients[clients_connecting];
+        ++ clients_connecting;
+        -- connects_left;
+
+        // Network subsystem can only have one server connection, so every
+        // client needs an instance of its own. It sends as often as real
+        // clients, which use the settings of the subsystem.
+        client.network = new Urho3D::Network(context_);
+        client.network->SetUpdateFps(GetSubsystem<Urho3D::Network>()->GetUpdateFps());
+        client.scene = new Urho3D::Scene(context_);
+        client.input.setSendRate(client.network->GetUpdateFps());
+        SubscribeToEvent(client.network, Urho3D::E_SERVERCONNECTED, URHO3D_HANDLER(LoadGenerator, handleServerConnected));
+        SubscribeToEvent(client.network, Urho3D::E_CONNECTFAILED, URHO3D_HANDLER(LoadGenerator, handleConnectFailed));
+
+        client.connect_began = std::chrono::steady_clock::now();
+        if (!client.network->Connect("localhost", port, client.scene)) {
+            client.failed = true;
+        }
+    }
+}
+
+void LoadGenerator::sendSyntheticControls(unsigned client_index, float deltatime)
+{
+    Client& client = clients[client_index];
+    if (client.connect_latency < 0) {
+        return;
+    }
+    Urho3D::Connection* conn = client.network->GetServerConnection();
+    if (!conn) {
+        return;
+    }
+
+    // Move forward while slowly turning, and change
+    // vertical direction once per few seconds.
+    Urho3D::Controls controls;
+    controls.buttons_ = CTRL_FORWARD;
+    if ((unsigned(time / 2) + client_index) % 2 == 0) {
+        controls.buttons_ |= CTRL_JUMP;
+    } else {
+        controls.buttons_ |= CTRL_CROUCH;
+    }
+    controls.yaw_ = std::fmod(client_index * 37 + time * 30, 360.0f);
+    controls.pitch_ = 0;
+    client.input.addInput(controls, ++ client.input_sequence, InputSender::quantizeDeltatime(deltatime));
+    client.input.update(conn, deltatime);
+}
+
+void LoadGenerator::sampleBandwidth()
+{
+    for (Client& client : clients) {
+        if (client.connect_latency < 0) {
+            continue;
+        }
+        Urho3D::Connection* conn = client.network->GetServerConnection();
+        if (conn && conn->IsConnected()) {
+            bytes_in_sum += conn->GetBytesInPerSec();
+            bytes_out_sum += conn->GetBytesOutPerSec();
+            ++ bandwidth_samples;
+        }
+    }
+}
+
+LoadGenerator::Client* LoadGenerator::getClient(Urho3D::Network* network)
+{
+    for (Client& client : clients) {
+        if (client.network == network) {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+void LoadGenerator::printReport()
+{
+    unsigned connected = 0;
+    unsigned failed = 0;
+    float latency_sum = 0;
+    float latency_max = 0;
+    for (Client const& client : clients) {
+        if (client.connect_latency >= 0) {
+            ++ connected;
+            latency_sum += client.connect_latency;
+            latency_max = Urho3D::Max(latency_max, client.connect_latency);
+        } else if (client.failed) {
+            ++ failed;
+        }
+    }
+
+    Urho3D::String result;
+    result.AppendWithFormat(
+        "{\"clients\": %u, \"connected\": %u, \"failed\": %u, \"duration\": %g, "
+        "\"connect_latency_avg_ms\": %.2f, \"connect_latency_max_ms\": %.2f, "
+        "\"server_ticks\": %u, \"server_tick_avg_us\": %.2f, \"server_tick_max_us\": %.2f, "
+        "\"bytes_in_per_client_per_sec\": %.1f, \"bytes_out_per_client_per_sec\": %.1f}",
+        clients.Size(), connected, failed, time,
+        connected > 0 ? latency_sum / connected * 1000 : 0.0f, latency_max * 1000,
+        tick_stats.ticks, tick_stats.ticks > 0 ? double(tick_stats.total) / tick_stats.ticks / 1000 : 0.0, tick_stats.max / 1000.0,
+        bandwidth_samples > 0 ? bytes_in_sum / bandwidth_samples : 0.0, bandwidth_samples > 0 ? bytes_out_sum / bandwidth_samples : 0.0
+    );
+    Urho3D::PrintLine(result);
+}
+
+}
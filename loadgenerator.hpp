@@ -0,0 +1,90 @@
+#ifndef GAMELIB_LOADGENERATOR_HPP
+#define GAMELIB_LOADGENERATOR_HPP
+
+#include "inputstream.hpp"
+#include "serverstate.hpp"
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <chrono>
+#include <cstdint>
+
+namespace GameLib
+{
+
+class App;
+
+// Connects synthetic clients to a local server and sends them scripted controls.
+// Connect latency, bandwidth per client and server tick time are measured, and
+// after given duration they are printed as one line of JSON, after which the
+// App is stopped.
+//
+// Network subsystem of Urho3D can only have one server connection, so every
+// client has a Network and Scene of its own. This way clients go through the
+// same kNet connections, replication and Scene updates as real clients, which
+// is the point of generating load, and there is no need to run hundreds of
+// processes. The extra Networks are not subsystems, so the only thing they
+// share with the subsystem is the whitelist of remote events, which Connection
+// reads from the subsystem. That is why client events are registered to it.
+class LoadGenerator : public Urho3D::Object
+{
+    URHO3D_OBJECT(LoadGenerator, Urho3D::Object);
+
+public:
+
+    // Server must be listening
+    LoadGenerator(App* app, Urho3D::Context* context, ServerState* server, unsigned clients_count, float duration);
+    virtual ~LoadGenerator();
+
+private:
+
+    struct Client
+    {
+        Urho3D::SharedPtr<Urho3D::Network> network;
+        Urho3D::SharedPtr<Urho3D::Scene> scene;
+        std::chrono::steady_clock::time_point connect_began;
+        // Seconds. Negative if not connected yet.
+        float connect_latency;
+        bool failed;
+        InputSender input;
+        unsigned input_sequence;
+    };
+    typedef Urho3D::Vector<Client> Clients;
+
+    App* app;
+    Urho3D::WeakPtr<ServerState> server;
+
+    uint16_t port;
+
+    Clients clients;
+    unsigned clients_connecting;
+
+    float duration;
+    float time;
+
+    // Bandwidth is sampled once per second from connected clients
+    float sample_timer;
+    unsigned bandwidth_samples;
+    double bytes_in_sum;
+    double bytes_out_sum;
+
+    ServerState::TickStats tick_stats;
+
+    void handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleServerConnected(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleConnectFailed(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+
+    void connectMoreClients();
+    void sendSyntheticControls(unsigned client_index, float deltatime);
+    void sampleBandwidth();
+
+    Client* getClient(Urho3D::Network* network);
+
+    void printReport();
+};
+
+}
+
+#endif
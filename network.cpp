@@ -4,8 +4,21 @@ namespace GameLib
 {
 
 const Urho3D::StringHash E_TO_CLIENT_SET_CONTROLLED_NODE("set_controlled_node");
+const Urho3D::StringHash E_TO_CLIENT_PREDICTION_ACK("prediction_ack");
+const Urho3D::StringHash E_TO_CLIENT_SERVER_INFO("server_info");
+const Urho3D::StringHash E_TO_CLIENT_RELEVANCE_CHANGED("relevance_changed");
 
 const Urho3D::StringHash P_ID("id");
+const Urho3D::StringHash P_SEQUENCE("sequence");
+const Urho3D::StringHash P_POSITION("position");
+const Urho3D::StringHash P_ROTATION("rotation");
+const Urho3D::StringHash P_UPDATE_RATE("update_rate");
+const Urho3D::StringHash P_HIDDEN("hidden");
+const Urho3D::StringHash P_SHOWN("shown");
+
+const int MSG_INPUT = 0x1000;
+
+const Urho3D::StringHash CTRL_EXTRA_SEQUENCE("sequence");
 
 const unsigned CTRL_FORWARD = 0x01;
 const unsigned CTRL_BACKWARD = 0x02;
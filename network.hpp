@@ -7,8 +7,23 @@ namespace GameLib
 {
 
 extern const Urho3D::StringHash E_TO_CLIENT_SET_CONTROLLED_NODE;
+extern const Urho3D::StringHash E_TO_CLIENT_PREDICTION_ACK;
+extern const Urho3D::StringHash E_TO_CLIENT_SERVER_INFO;
+extern const Urho3D::StringHash E_TO_CLIENT_RELEVANCE_CHANGED;
 
 extern const Urho3D::StringHash P_ID;
+extern const Urho3D::StringHash P_SEQUENCE;
+extern const Urho3D::StringHash P_POSITION;
+extern const Urho3D::StringHash P_ROTATION;
+extern const Urho3D::StringHash P_UPDATE_RATE;
+extern const Urho3D::StringHash P_HIDDEN;
+extern const Urho3D::StringHash P_SHOWN;
+
+// Compact inputs from client to server. Urho3D uses smaller IDs for its own messages.
+extern const int MSG_INPUT;
+
+// Key of input sequence number in extra data of Controls
+extern const Urho3D::StringHash CTRL_EXTRA_SEQUENCE;
 
 extern const unsigned CTRL_FORWARD;
 extern const unsigned CTRL_BACKWARD;
@@ -0,0 +1,208 @@
+#include "networkstats.hpp"
+
+#include "gameobject.hpp"
+#include "gameobjectregistry.hpp"
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/NetworkEvents.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace GameLib
+{
+
+float const REPLICATION_SAMPLE_INTERVAL = 1;
+
+// Estimated size of a Node update that has new position and packed
+// rotation, including Node ID, dirty attribute mask and message header.
+unsigned const REPLICATED_MOVE_BYTES = 12 + 8 + 6;
+
+static void logTraffic(char const* title, NetworkStats::Traffic const& traffic, float duration)
+{
+    // Largest first
+    typedef std::pair<uint64_t, Urho3D::String> Line;
+    std::vector<Line> lines;
+    for (NetworkStats::Traffic::ConstIterator i = traffic.Begin(); i != traffic.End(); ++ i) {
+        Urho3D::String line;
+        line.AppendWithFormat(
+            "%s: %u times, %.1f kB, %.2f kB/s",
+            i->first_.CString(), i->second_.count, i->second_.bytes / 1000.0, i->second_.bytes / 1000.0 / Urho3D::Max(duration, 0.001f)
+        );
+        lines.push_back(Line(i->second_.bytes, line));
+    }
+    std::sort(lines.begin(), lines.end(), [](Line const& a, Line const& b) {
+        return a.first > b.first;
+    });
+
+    if (!lines.empty()) {
+        URHO3D_LOGINFO(title);
+    }
+    for (Line const& line : lines) {
+        URHO3D_LOGINFO("    " + line.second);
+    }
+}
+
+NetworkStats::NetworkStats() :
+    log_interval(0),
+    duration(0),
+    sample_timer(0)
+{
+}
+
+void NetworkStats::setLogInterval(float interval)
+{
+    log_interval = interval;
+    reset();
+}
+
+void NetworkStats::update(float deltatime, Urho3D::Network* network, GameObjectRegistry* registry)
+{
+    duration += deltatime;
+
+    sample_timer += deltatime;
+    if (sample_timer >= REPLICATION_SAMPLE_INTERVAL) {
+        if (registry) {
+            sampleReplication(sample_timer, network, registry);
+        }
+        sample_timer = 0;
+    }
+
+    if (log_interval > 0 && duration >= log_interval) {
+        logSummary(network);
+        reset();
+    }
+}
+
+void NetworkStats::setEventTypes(Urho3D::Vector<Urho3D::StringHash> const& event_types)
+{
+    event_names.Clear();
+    for (Urho3D::StringHash const& event_type : event_types) {
+        Urho3D::String const& name = Urho3D::EventNameRegistrar::GetEventName(event_type);
+        event_names[event_type] = name.Empty() ? event_type.ToString() : name;
+    }
+}
+
+void NetworkStats::addEvent(Urho3D::StringHash const& event_type, Urho3D::VariantMap const& event_data)
+{
+    // Connection is added to the data by Urho3D, so it is not counted
+    Urho3D::VariantMap sent_data = event_data;
+    sent_data.Erase(Urho3D::RemoteEventData::P_CONNECTION);
+    Urho3D::VectorBuffer buf;
+    buf.WriteStringHash(event_type);
+    buf.WriteVariantMap(sent_data);
+
+    Urho3D::HashMap<Urho3D::StringHash, Urho3D::String>::ConstIterator event_names_find = event_names.Find(event_type);
+    TrafficStats& stats = events[event_names_find != event_names.End() ? event_names_find->second_ : event_type.ToString()];
+    ++ stats.count;
+    stats.bytes += buf.GetSize();
+}
+
+void NetworkStats::addMessage(Urho3D::String const& name, unsigned bytes)
+{
+    TrafficStats& stats = messages[name];
+    ++ stats.count;
+    stats.bytes += bytes;
+}
+
+void NetworkStats::getConnectionsStats(ConnectionsStats& result, Urho3D::Network* network)
+{
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Connection> > conns = network->GetClientConnections();
+    if (network->GetServerConnection()) {
+        conns.Push(Urho3D::SharedPtr<Urho3D::Connection>(network->GetServerConnection()));
+    }
+    for (Urho3D::Connection* conn : conns) {
+        ConnectionStats stats;
+        stats.address = conn->ToString();
+        stats.bytes_in = conn->GetBytesInPerSec();
+        stats.bytes_out = conn->GetBytesOutPerSec();
+        stats.packets_in = conn->GetPacketsInPerSec();
+        stats.packets_out = conn->GetPacketsOutPerSec();
+        stats.round_trip_time = conn->GetRoundTripTime();
+        result.Push(stats);
+    }
+}
+
+NetworkStats::Traffic const& NetworkStats::getEventStats() const
+{
+    return events;
+}
+
+NetworkStats::Traffic const& NetworkStats::getMessageStats() const
+{
+    return messages;
+}
+
+NetworkStats::Traffic const& NetworkStats::getReplicationStats() const
+{
+    return replication;
+}
+
+float NetworkStats::getDuration() const
+{
+    return duration;
+}
+
+void NetworkStats::logSummary(Urho3D::Network* network) const
+{
+    URHO3D_LOGINFOF("Network statistics of last %.1f seconds:", duration);
+
+    ConnectionsStats conns_stats;
+    getConnectionsStats(conns_stats, network);
+    for (ConnectionStats const& stats : conns_stats) {
+        URHO3D_LOGINFOF(
+            "  %s: in %.2f kB/s, %.0f packets/s, out %.2f kB/s, %.0f packets/s, round trip %.0f ms",
+            stats.address.CString(), stats.bytes_in / 1000, stats.packets_in, stats.bytes_out / 1000, stats.packets_out, stats.round_trip_time
+        );
+    }
+
+    logTraffic("  Received events:", events, duration);
+    logTraffic("  Messages:", messages, duration);
+    logTraffic("  Estimated replication:", replication, duration);
+}
+
+void NetworkStats::reset()
+{
+    duration = 0;
+    events.Clear();
+    messages.Clear();
+    replication.Clear();
+}
+
+void NetworkStats::sampleReplication(float period, Urho3D::Network* network, GameObjectRegistry* registry)
+{
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Connection> > conns = network->GetClientConnections();
+    // Moves are sent at most once per network update
+    unsigned max_updates = unsigned(Urho3D::Ceil(period * network->GetUpdateFps()));
+
+    registry->lockIteration();
+    for (unsigned i = 0; i < registry->getNumGameObjects(); ++ i) {
+        GameObject* gameobj = registry->getGameObject(i);
+        if (!gameobj) {
+            continue;
+        }
+        unsigned moves = Urho3D::Min(gameobj->popMoveCount(), max_updates);
+        if (!moves) {
+            continue;
+        }
+        // Clients in the hysteresis range are counted as if they got every update
+        unsigned clients = 0;
+        for (Urho3D::Connection* conn : conns) {
+            if (gameobj->isRelevantTo(conn)) {
+                ++ clients;
+            }
+        }
+        if (!clients) {
+            continue;
+        }
+        TrafficStats& stats = replication[gameobj->GetTypeName()];
+        stats.count += moves * clients;
+        stats.bytes += uint64_t(moves) * clients * REPLICATED_MOVE_BYTES;
+    }
+    registry->unlockIteration();
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef GAMELIB_NETWORKSTATS_HPP
+#define GAMELIB_NETWORKSTATS_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Network/Network.h>
+
+#include <cstdint>
+
+namespace GameLib
+{
+
+class GameObjectRegistry;
+
+// Collects statistics of network traffic for ServerState and GameState. Rates
+// of Connections come from Urho3D, and they are the real totals, including
+// messages of Urho3D itself. Received custom network events are counted by
+// their serialized size, and own messages, like inputs, by their size. Urho3D
+// does not tell how much replication of each Node costs, so on server it is
+// estimated per GameObject type from how often Nodes move, as if every move
+// sent position and rotation to every client that gets updates of the Node
+// according to its relevance. Urho3D does not expose resends either, so they
+// are not included.
+class NetworkStats
+{
+
+public:
+
+    // Rates are per second
+    struct ConnectionStats
+    {
+        Urho3D::String address;
+        float bytes_in;
+        float bytes_out;
+        float packets_in;
+        float packets_out;
+        // In milliseconds
+        float round_trip_time;
+    };
+    typedef Urho3D::Vector<ConnectionStats> ConnectionsStats;
+
+    // Totals since statistics were reset
+    struct TrafficStats
+    {
+        unsigned count;
+        uint64_t bytes;
+    };
+    // Keys are names of event types and GameObject types
+    typedef Urho3D::HashMap<Urho3D::String, TrafficStats> Traffic;
+
+    NetworkStats();
+
+    // If interval is positive, a summary is written to log every
+    // that many seconds, after which the statistics are reset.
+    void setLogInterval(float interval);
+
+    // Called by ServerState and GameState every frame. If registry
+    // is given, then its replication to clients is estimated.
+    void update(float deltatime, Urho3D::Network* network, GameObjectRegistry* registry = NULL);
+
+    // Names of received events are looked up from these. Events that are
+    // declared with URHO3D_EVENT get their names, others are shown as hashes.
+    void setEventTypes(Urho3D::Vector<Urho3D::StringHash> const& event_types);
+
+    // Counts received custom network event
+    void addEvent(Urho3D::StringHash const& event_type, Urho3D::VariantMap const& event_data);
+
+    // Counts sent or received message that is not a network event
+    void addMessage(Urho3D::String const& name, unsigned bytes);
+
+    // Current rates of the server connection and client connections
+    static void getConnectionsStats(ConnectionsStats& result, Urho3D::Network* network);
+
+    Traffic const& getEventStats() const;
+    Traffic const& getMessageStats() const;
+    Traffic const& getReplicationStats() const;
+
+    // Seconds since statistics were reset
+    float getDuration() const;
+
+    void logSummary(Urho3D::Network* network) const;
+
+    void reset();
+
+private:
+
+    float log_interval;
+    float duration;
+    // Replication is sampled once per this many seconds
+    float sample_timer;
+
+    Urho3D::HashMap<Urho3D::StringHash, Urho3D::String> event_names;
+
+    Traffic events;
+    Traffic messages;
+    Traffic replication;
+
+    void sampleReplication(float period, Urho3D::Network* network, GameObjectRegistry* registry);
+};
+
+}
+
+#endif
@@ -1,23 +1,49 @@
 #ifndef GAME_PLAYER_HPP
 #define GAME_PLAYER_HPP
 
+#include "inputstream.hpp"
+#include "timerwheel.hpp"
+
 #include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Input/Controls.h>
 #include <Urho3D/Network/Connection.h>
 
+#include <set>
+
 namespace GameLib
 {
 
 struct Player : public Urho3D::RefCounted
 {
     unsigned controlled_node_id;
-    time_t respawn_at;
+    TimerWheel::TimerId respawn_timer;
 
     Urho3D::Connection* conn;
 
+    // Controls of the current tick. If there is a connection,
+    // these are got from inputs that it has sent.
+    Urho3D::Controls controls;
+    InputReceiver input;
+    // If controlled Node is run once per input, then this is how many
+    // seconds of inputs may still be applied. It grows with ticks, so
+    // client cannot move faster by sending inputs with longer deltatimes.
+    float input_time;
+
+    // IDs of Nodes that the client has been told to hide
+    std::set<unsigned> hidden_node_ids;
+    // IDs of shown Nodes that were near the client when relevance was
+    // last checked. Only these and Nodes near the client now can have
+    // gone out of relevance by moving.
+    std::set<unsigned> near_node_ids;
+    // If false, relevance of every Node is checked for the client
+    bool relevance_checked;
+
     inline Player(Urho3D::Connection* conn) :
         controlled_node_id(0),
-        respawn_at(0),
-        conn(conn)
+        respawn_timer(0),
+        conn(conn),
+        input_time(0),
+        relevance_checked(false)
     {
     }
 };
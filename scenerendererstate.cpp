@@ -20,12 +20,22 @@ App* SceneRendererState::getApp()
     return app;
 }
 
+Urho3D::Node* SceneRendererState::createCameraNode()
+{
+    camera_node = app->getScene()->CreateChild("camera", Urho3D::LOCAL);
+    return camera_node;
+}
+
+Urho3D::Node* SceneRendererState::getCameraNode()
+{
+    return camera_node;
+}
+
 void SceneRendererState::prepareSceneForRendering()
 {
     Urho3D::Renderer* renderer = GetSubsystem<Urho3D::Renderer>();
 
     // Create viewport
-    Urho3D::Node* camera_node = app->getScene()->GetChild("camera");
     Urho3D::SharedPtr<Urho3D::Viewport> viewport(new Urho3D::Viewport(context_, app->getScene(), camera_node->GetComponent<Urho3D::Camera>()));
     renderer->SetViewport(0, viewport);
 
@@ -3,6 +3,8 @@
 
 #include "../urhoextras/states/state.hpp"
 
+#include <Urho3D/Scene/Node.h>
+
 namespace GameLib
 {
 
@@ -19,11 +21,18 @@ protected:
 
     App* getApp();
 
+    // Creates a local camera node to the Scene. The node
+    // is remembered so it does not need to be searched for.
+    Urho3D::Node* createCameraNode();
+    Urho3D::Node* getCameraNode();
+
     void prepareSceneForRendering();
 
 private:
 
     App* app;
+
+    Urho3D::WeakPtr<Urho3D::Node> camera_node;
 };
 
 }
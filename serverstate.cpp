@@ -2,22 +2,25 @@
 
 #include "app.hpp"
 #include "gameobject.hpp"
+#include "gameobjectregistry.hpp"
 #include "network.hpp"
+#include "tickprofiler.hpp"
 #include "../urhoextras/mathutils.hpp"
 
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Graphics/Model.h>
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/IO/Log.h>
-#include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/Network/Network.h>
 #include <Urho3D/Network/NetworkEvents.h>
-#include <Urho3D/Physics/PhysicsEvents.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
 #include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/SceneEvents.h>
 
+#include <chrono>
+#include <cmath>
 #include <csignal>
-#include <ctime>
 #include <stdexcept>
 
 namespace GameLib
@@ -31,10 +34,43 @@ void handleStopServerSignal(int sig)
 
 bool ServerState::run_server = true;
 
-ServerState::ServerState(App* app, Urho3D::Context* context, uint16_t port) :
+// How many fixed ticks can be run during one frame to catch up
+unsigned const MAX_CATCHUP_TICKS = 5;
+
+// Milliseconds from destruction of controlled node to respawn
+uint64_t const RESPAWN_DELAY = 4000;
+
+// Skipped time is logged at most once per this many seconds
+float const SKIP_WARNING_INTERVAL = 5;
+
+// How many seconds of inputs a predicting client may catch
+// up with after it has not sent any for a while
+float const MAX_INPUT_TIME = 0.5f;
+
+// Relevance is checked once per replicated root Node,
+// through the GameObject that registry knows it by.
+static bool checksRelevance(GameObjectRegistry* registry, Urho3D::Scene* scene, GameObject* gameobj)
+{
+    Urho3D::Node* node = gameobj->GetNode();
+    return node->GetParent() == scene && node->IsReplicated() && registry->findGameObject(node) == gameobj;
+}
+
+ServerState::ServerState(App* app, Urho3D::Context* context, uint16_t port, unsigned tick_rate) :
     UrhoExtras::States::State(context),
-    app(app)
+    app(app),
+    port(port),
+    tick_length(tick_rate > 0 ? 1.0f / tick_rate : 0.0f),
+    tick_accumulator(0),
+    skipped_time(0),
+    time_since_skip_warning(SKIP_WARNING_INTERVAL),
+    parallel_deltatime(0)
 {
+    tick_stats.ticks = 0;
+    tick_stats.total = 0;
+    tick_stats.max = 0;
+
+    network_stats.setLogInterval(app->getNetworkStatsLogInterval());
+
     // Set up signal handlers for stopping the server
     #ifndef _WIN32
     ::signal(SIGINT, &handleStopServerSignal);
@@ -44,6 +80,13 @@ ServerState::ServerState(App* app, Urho3D::Context* context, uint16_t port) :
 
     // Scene
     app->getScene()->CreateComponent<Urho3D::PhysicsWorld>();
+    app->getGameObjectRegistry()->getCollisionDispatcher()->setEnabled(true);
+
+    // Keep history for lag compensation. With variable timestep, history
+    // is recorded at most 60 times per second, so it covers the whole
+    // length however fast the server runs.
+    float history_interval = tick_rate > 0 ? 1.0f / tick_rate : 1.0f / 60;
+    app->getGameObjectRegistry()->getLagCompensation().setCapacity(app->getLagCompensationHistoryLength(), history_interval, app->getMaxLagCompensatedGameObjects());
 
     app->initializeSceneOnServer();
 
@@ -51,10 +94,21 @@ ServerState::ServerState(App* app, Urho3D::Context* context, uint16_t port) :
         return;
     }
 
+    // Physics is stepped once per tick, so GameObjects and physics see the
+    // same time, even when ticks are run to catch up. This is done after
+    // initializing, because loading the Scene may replace PhysicsWorld.
+    physics = app->getScene()->GetComponent<Urho3D::PhysicsWorld>();
+    if (physics) {
+        physics->SetUpdateEnabled(false);
+        if (tick_rate > 0) {
+            physics->SetFps(tick_rate);
+        }
+    }
+
     // Subscribe to events
     SubscribeToEvent(Urho3D::E_CLIENTCONNECTED, URHO3D_HANDLER(ServerState, handleClientConnected));
     SubscribeToEvent(Urho3D::E_CLIENTDISCONNECTED, URHO3D_HANDLER(ServerState, handleClientDisconnected));
-    SubscribeToEvent(Urho3D::E_PHYSICSCOLLISION, URHO3D_HANDLER(ServerState, handlePhysicsCollision));
+    SubscribeToEvent(Urho3D::E_NETWORKMESSAGE, URHO3D_HANDLER(ServerState, handleNetworkMessage));
 
     // Subscribe to custom network events
     Urho3D::Vector<Urho3D::StringHash> network_events;
@@ -63,6 +117,16 @@ ServerState::ServerState(App* app, Urho3D::Context* context, uint16_t port) :
         SubscribeToEvent(network_event, URHO3D_HANDLER(ServerState, handleCustomNetworkEvent));
         GetSubsystem<Urho3D::Network>()->RegisterRemoteEvent(network_event);
     }
+    network_stats.setEventTypes(network_events);
+
+    if (!port) {
+        return;
+    }
+
+    // Send network updates once per tick
+    if (tick_rate > 0) {
+        GetSubsystem<Urho3D::Network>()->SetUpdateFps(tick_rate);
+    }
 
     // Start listening connections
     if (!GetSubsystem<Urho3D::Network>()->StartServer(port)) {
@@ -74,16 +138,36 @@ void ServerState::show()
 {
     SubscribeToEvent(Urho3D::E_KEYDOWN, URHO3D_HANDLER(ServerState, handleKeyDown));
     SubscribeToEvent(Urho3D::E_UPDATE, URHO3D_HANDLER(ServerState, handleUpdate));
+    SubscribeToEvent(app->getScene(), Urho3D::E_NODEREMOVED, URHO3D_HANDLER(ServerState, handleNodeRemoved));
 }
 
 void ServerState::hide()
 {
     UnsubscribeFromEvent(Urho3D::E_KEYDOWN);
     UnsubscribeFromEvent(Urho3D::E_UPDATE);
+    UnsubscribeFromEvent(app->getScene(), Urho3D::E_NODEREMOVED);
 }
 
 void ServerState::removed()
 {
+    // Cancel respawns, because they refer to this state
+    for (Players::iterator i = players.begin(); i != players.end(); ++ i) {
+        Player* player = *i;
+        if (player->respawn_timer) {
+            app->getGameObjectRegistry()->getTimers().cancel(player->respawn_timer);
+            player->respawn_timer = 0;
+        }
+    }
+}
+
+Player* ServerState::addLocalPlayer()
+{
+    Urho3D::SharedPtr<Player> player(new Player(nullptr));
+    players.insert(player);
+
+    createNodeAndGameObjectForPlayer(player);
+
+    return player;
 }
 
 void ServerState::createNodeAndGameObjectForPlayer(Player* player)
@@ -99,12 +183,179 @@ void ServerState::createNodeAndGameObjectForPlayer(Player* player)
     node_controllers[player_node->GetID()] = Urho3D::SharedPtr<Player>(player);
     player->controlled_node_id = player_node->GetID();
 
-    player_node->SetOwner(player->conn);
+    // If player is human, then inform about the controlled node
+    if (player->conn) {
+        player_node->SetOwner(player->conn);
 
-    // Inform about the controlled node
-    Urho3D::VariantMap event_args;
-    event_args[P_ID] = player_node->GetID();
-    player->conn->SendRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE, true, event_args);
+        Urho3D::VariantMap event_args;
+        event_args[P_ID] = player_node->GetID();
+        player->conn->SendRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE, true, event_args);
+    }
+}
+
+Urho3D::Controls const* ServerState::getControls(Urho3D::Node* node)
+{
+    NodeControllers::iterator node_controllers_find = node_controllers.find(node->GetID());
+    if (node_controllers_find != node_controllers.end()) {
+        Player* player = node_controllers_find->second;
+        return &player->controls;
+    }
+    return nullptr;
+}
+
+Player* ServerState::getPredictingPlayer(Urho3D::Node* node)
+{
+    NodeControllers::iterator node_controllers_find = node_controllers.find(node->GetID());
+    if (node_controllers_find == node_controllers.end() || !node_controllers_find->second->conn) {
+        return nullptr;
+    }
+    GameObject* gameobj = app->getGameObjectRegistry()->findGameObject(node);
+    if (!gameobj || gameobj->GetNode() != node || !gameobj->supportsPrediction()) {
+        return nullptr;
+    }
+    return node_controllers_find->second;
+}
+
+void ServerState::runPredictedNodes(float deltatime)
+{
+    // Node destruction modifies controllers, so collect Nodes first
+    Urho3D::Vector<Urho3D::WeakPtr<Urho3D::Node> > nodes;
+    for (NodeControllers::iterator i = node_controllers.begin(); i != node_controllers.end(); ++ i) {
+        Urho3D::Node* node = app->getScene()->GetNode(i->first);
+        if (node && getPredictingPlayer(node)) {
+            nodes.Push(Urho3D::WeakPtr<Urho3D::Node>(node));
+        }
+    }
+
+    // Apply every input exactly once, with the deltatime client predicted
+    // it with. If inputs do not arrive, Node waits for them, and then
+    // catches up, so server ends up where prediction did.
+    for (Urho3D::Node* node : nodes) {
+        // Previous Nodes might have destroyed this
+        Urho3D::SharedPtr<Player> player(node ? getPredictingPlayer(node) : nullptr);
+        if (!player) {
+            continue;
+        }
+        player->input_time = Urho3D::Min(player->input_time + deltatime, MAX_INPUT_TIME);
+        float input_deltatime;
+        while (player->input_time > 0 && player->input.popInput(player->controls, input_deltatime)) {
+            player->input_time -= input_deltatime;
+            if (!runNodeGameObjects(node, input_deltatime, &player->controls)) {
+                destroyNode(node);
+                break;
+            }
+        }
+    }
+}
+
+bool ServerState::runNodeGameObjects(Urho3D::Node* node, float deltatime, Urho3D::Controls const* controls)
+{
+    Urho3D::PODVector<GameObject*> gameobjs;
+    node->GetDerivedComponents<GameObject>(gameobjs);
+    for (GameObject* gameobj : gameobjs) {
+        if (gameobj->isSleeping()) {
+            continue;
+        }
+        TickProfiler::Scope profile(gameobj, TickProfiler::RUN_SERVER_SIDE);
+        if (!gameobj->runServerSide(deltatime, controls)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ServerState::destroyNode(Urho3D::Node* node)
+{
+    // If node was controlled by somebody, then initiate a respawn
+    NodeControllers::iterator node_controllers_find = node_controllers.find(node->GetID());
+    if (node_controllers_find != node_controllers.end()) {
+        Player* player = node_controllers_find->second;
+        // If node belongs to a human player, then inform they no longer control it
+        if (player->conn) {
+            Urho3D::VariantMap event_args;
+            event_args[P_ID] = 0;
+            player->conn->SendRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE, true, event_args);
+        }
+        // Initiate a respawn
+        player->controlled_node_id = 0;
+        player->respawn_timer = app->getGameObjectRegistry()->getTimers().schedule(RESPAWN_DELAY, [this, player]() {
+            player->respawn_timer = 0;
+            createNodeAndGameObjectForPlayer(player);
+        });
+        // Remove controlling
+        node_controllers.erase(node_controllers_find);
+    }
+
+    // This also removes all GameObjects of the node from the registry
+    node->Remove();
+}
+
+void ServerState::runGameObjectsInParallel(float deltatime)
+{
+    // Collect GameObjects that can be run in worker threads. Controls
+    // are looked up here, because worker threads must not touch them.
+    GameObjectRegistry* registry = app->getGameObjectRegistry();
+    Urho3D::Scene* scene = app->getScene();
+    parallel_jobs.Clear();
+    for (unsigned i = 0; i < registry->getNumAwakeGameObjects(); ++ i) {
+        GameObject* gameobj = registry->getAwakeGameObject(i);
+        if (gameobj && gameobj->getRunsInParallel() && gameobj->GetNode()->GetParent() == scene && !getPredictingPlayer(gameobj->GetNode())) {
+            ParallelJob job;
+            job.gameobj = gameobj;
+            job.controls = getControls(gameobj->GetNode());
+            job.keep = true;
+            parallel_jobs.Push(job);
+        }
+    }
+    if (parallel_jobs.Empty()) {
+        return;
+    }
+
+    // Split jobs into slightly more work items than there are threads, so
+    // threads that finish early can pick up remaining items from the queue.
+    Urho3D::WorkQueue* queue = GetSubsystem<Urho3D::WorkQueue>();
+    unsigned items_count = Urho3D::Min(parallel_jobs.Size(), (queue->GetNumThreads() + 1) * 4);
+    unsigned jobs_per_item = (parallel_jobs.Size() + items_count - 1) / items_count;
+    parallel_deltatime = deltatime;
+
+    scene->BeginThreadedUpdate();
+    for (unsigned begin = 0; begin < parallel_jobs.Size(); begin += jobs_per_item) {
+        unsigned end = Urho3D::Min(begin + jobs_per_item, parallel_jobs.Size());
+        Urho3D::SharedPtr<Urho3D::WorkItem> item = queue->GetFreeItem();
+        item->priority_ = Urho3D::M_MAX_UNSIGNED;
+        item->workFunction_ = runParallelJobs;
+        item->start_ = &parallel_jobs[begin];
+        item->end_ = &parallel_jobs[0] + end;
+        item->aux_ = this;
+        queue->AddWorkItem(item);
+    }
+    queue->Complete(Urho3D::M_MAX_UNSIGNED);
+    scene->EndThreadedUpdate();
+
+    // Destroy nodes in the original order of GameObjects, so the result
+    // does not depend on which thread happened to run which GameObject.
+    registry->lockIteration();
+    for (unsigned i = 0; i < parallel_jobs.Size(); ++ i) {
+        ParallelJob const& job = parallel_jobs[i];
+        // GameObject might have been removed by an earlier node destruction
+        if (!job.keep && job.gameobj) {
+            destroyNode(job.gameobj->GetNode());
+        }
+    }
+    registry->unlockIteration();
+    parallel_jobs.Clear();
+}
+
+void ServerState::runParallelJobs(Urho3D::WorkItem const* item, unsigned thread_index)
+{
+    ServerState* state = static_cast<ServerState*>(item->aux_);
+    ParallelJob* job = static_cast<ParallelJob*>(item->start_);
+    ParallelJob* end = static_cast<ParallelJob*>(item->end_);
+    while (job != end) {
+        TickProfiler::Scope profile(job->gameobj, TickProfiler::RUN_SERVER_SIDE, thread_index);
+        job->keep = job->gameobj->runServerSide(state->parallel_deltatime, job->controls);
+        ++ job;
+    }
 }
 
 void ServerState::handleKeyDown(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
@@ -127,7 +378,8 @@ void ServerState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap
     (void)event_type;
 
     float deltatime = event_data[Urho3D::Update::P_TIMESTEP].GetFloat();
-(void)deltatime;
+
+    network_stats.update(deltatime, GetSubsystem<Urho3D::Network>(), app->getGameObjectRegistry());
 
     // If stop was requested
     if (!run_server) {
@@ -137,70 +389,294 @@ void ServerState::handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap
         return;
     }
 
-    // Run game objects
-    Urho3D::HashSet<Urho3D::Node*> removed_nodes;
-    Urho3D::PODVector<Urho3D::Node*> children = app->getScene()->GetChildren(false);
-    for (unsigned i = 0; i < children.Size(); ++ i) {
-        Urho3D::Node* child_node = children[i];
+    // Variable timestep
+    if (tick_length <= 0) {
+        runTick(deltatime);
+        updateRelevanceCenters();
+        sendRelevanceChanges();
+        sendPredictionAcks();
+        return;
+    }
+
+    // Fixed timestep. Run as many ticks as there is time for,
+    // but if server falls too much behind, then skip some time.
+    tick_accumulator += deltatime;
+    unsigned ticks = 0;
+    while (tick_accumulator >= tick_length && ticks < MAX_CATCHUP_TICKS) {
+        runTick(tick_length);
+        tick_accumulator -= tick_length;
+        ++ ticks;
+    }
+    if (tick_accumulator >= tick_length) {
+        skipped_time += Urho3D::Floor(tick_accumulator / tick_length) * tick_length;
+        tick_accumulator = std::fmod(tick_accumulator, tick_length);
+    }
+    time_since_skip_warning += deltatime;
+    if (skipped_time > 0 && time_since_skip_warning >= SKIP_WARNING_INTERVAL) {
+        URHO3D_LOGWARNINGF("Server is running behind, skipped %.0f ms during last %.1f seconds!", skipped_time * 1000, time_since_skip_warning);
+        skipped_time = 0;
+        time_since_skip_warning = 0;
+    }
+    if (ticks) {
+        updateRelevanceCenters();
+        sendRelevanceChanges();
+        sendPredictionAcks();
+    }
+}
+
+void ServerState::handleNodeRemoved(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    // Only root Nodes are hidden from clients
+    Urho3D::Node* parent = static_cast<Urho3D::Node*>(event_data[Urho3D::NodeRemoved::P_PARENT].GetPtr());
+    if (parent == app->getScene()) {
+        Urho3D::Node* node = static_cast<Urho3D::Node*>(event_data[Urho3D::NodeRemoved::P_NODE].GetPtr());
+        removed_node_ids.Push(node->GetID());
+    }
+}
+
+void ServerState::runTick(float deltatime)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    // Get controls that clients have sent since the previous tick.
+    // Predicted Nodes use inputs one by one instead.
+    for (Players::iterator i = players.begin(); i != players.end(); ++ i) {
+        Player* player = *i;
+        Urho3D::Node* node = app->getScene()->GetNode(player->controlled_node_id);
+        if (player->conn && (!node || getPredictingPlayer(node) != player)) {
+            player->input.popControls(player->controls);
+        }
+    }
+
+    // Fire timers. This runs respawns and wakes GameObjects whose sleep has ended.
+    GameObjectRegistry* registry = app->getGameObjectRegistry();
+    registry->getTimers().advanceSeconds(deltatime);
 
-        // If node was removed, then skip it
-        if (removed_nodes.Contains(child_node)) {
+    TickProfiler::update(deltatime);
+
+    runPredictedNodes(deltatime);
+
+    // Run game objects that can be run in parallel, if this is enabled
+    bool parallel_tick = app->getParallelServerTick();
+    if (parallel_tick) {
+        runGameObjectsInParallel(deltatime);
+    }
+
+    // Run rest of game objects
+    Urho3D::Scene* scene = app->getScene();
+    registry->lockIteration();
+    unsigned gameobjs_count = registry->getNumAwakeGameObjects();
+    for (unsigned i = 0; i < gameobjs_count; ++ i) {
+        GameObject* gameobj = registry->getAwakeGameObject(i);
+
+        // If GameObject was removed, put to sleep or it was already run, then skip it
+        if (!gameobj || (parallel_tick && gameobj->getRunsInParallel())) {
             continue;
         }
 
-        // Check if this node is controlled by somebody
-        NodeControllers::iterator node_controllers_find = node_controllers.find(child_node->GetID());
-        Player* player = NULL;
-        if (node_controllers_find != node_controllers.end()) {
-            player = node_controllers_find->second;
+        // Only GameObjects of root Nodes are run, and
+        // destroying one destroys the whole root Node.
+        Urho3D::Node* node = gameobj->GetNode();
+        if (node->GetParent() != scene || getPredictingPlayer(node)) {
+            continue;
+        }
+        bool keep;
+        {
+            TickProfiler::Scope profile(gameobj, TickProfiler::RUN_SERVER_SIDE);
+            keep = gameobj->runServerSide(deltatime, getControls(node));
         }
+        if (!keep) {
+            destroyNode(node);
+        }
+    }
+    registry->unlockIteration();
 
-        // Run possible GameObjects in this node
-        bool node_was_destroyed = false;
-        for (unsigned j = 0; j < child_node->GetNumComponents(); ++ j) {
-            Urho3D::Component* component = child_node->GetComponents()[j];
-            GameObject* gameobj = dynamic_cast<GameObject*>(component);
-            if (gameobj) {
-                Urho3D::Controls const* controls = nullptr;
-                if (player && player->conn) {
-                    controls = &player->conn->GetControls();
-                }
-                if (!gameobj->runServerSide(deltatime, controls)) {
-                    child_node->Remove();
-                    removed_nodes.Insert(child_node);
-                    node_was_destroyed = true;
-                    break;
+    if (physics) {
+        physics->Update(deltatime);
+    }
+
+    // Remember where lag compensated GameObjects were after this tick
+    registry->getLagCompensation().record();
+
+    uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    ++ tick_stats.ticks;
+    tick_stats.total += duration;
+    tick_stats.max = Urho3D::Max(tick_stats.max, duration);
+}
+
+void ServerState::updateRelevanceCenters()
+{
+    for (Players::iterator i = players.begin(); i != players.end(); ++ i) {
+        Player* player = *i;
+        if (!player->conn) {
+            continue;
+        }
+        Urho3D::Node* node = app->getScene()->GetNode(player->controlled_node_id);
+        if (node) {
+            player->conn->SetPosition(node->GetWorldPosition());
+        }
+    }
+}
+
+void ServerState::sendRelevanceChanges()
+{
+    Urho3D::Scene* scene = app->getScene();
+    GameObjectRegistry* registry = app->getGameObjectRegistry();
+    // Nodes are shown a bit nearer than where they are hidden,
+    // so ones at the border do not keep flickering.
+    float show_margin = app->getRelevanceHysteresis() / 2;
+    // Nodes that are relevant by distance are nearer than this
+    float max_distance = app->getRelevanceDistance() + Urho3D::Max(app->getRelevanceHysteresis(), 0.001f);
+
+    // New Nodes and Nodes whose relevance has changed are checked for every
+    // client. Other Nodes can only go in or out of relevance by moving, so
+    // otherwise only Nodes that are or were near each client are checked.
+    Urho3D::PODVector<GameObject*> changed;
+    for (unsigned i = 0; i < registry->getNumRelevanceChangedGameObjects(); ++ i) {
+        GameObject* gameobj = registry->getRelevanceChangedGameObject(i);
+        if (gameobj && checksRelevance(registry, scene, gameobj)) {
+            changed.Push(gameobj);
+        }
+    }
+    registry->clearRelevanceChanged();
+
+    Urho3D::PODVector<GameObject*> near;
+    std::set<unsigned> near_node_ids;
+    for (Players::iterator i = players.begin(); i != players.end(); ++ i) {
+        Player* player = *i;
+        if (!player->conn) {
+            continue;
+        }
+        Urho3D::VariantVector hidden;
+        Urho3D::VariantVector shown;
+
+        // Forget removed Nodes. Client is told to show them, so
+        // it forgets them too, in case their IDs get reused.
+        for (unsigned node_id : removed_node_ids) {
+            if (player->hidden_node_ids.erase(node_id)) {
+                shown.Push(node_id);
+            }
+            player->near_node_ids.erase(node_id);
+        }
+
+        // Client that has just connected has not had any Nodes checked
+        if (!player->relevance_checked) {
+            for (unsigned j = 0; j < registry->getNumGameObjects(); ++ j) {
+                GameObject* gameobj = registry->getGameObject(j);
+                if (gameobj && checksRelevance(registry, scene, gameobj)) {
+                    checkRelevance(player, gameobj, show_margin, hidden, shown);
                 }
             }
+            player->relevance_checked = true;
+        } else {
+            for (GameObject* gameobj : changed) {
+                checkRelevance(player, gameobj, show_margin, hidden, shown);
+            }
+        }
+
+        // Nodes near the client. Hidden ones are shown when they get near enough.
+        near.Clear();
+        near_node_ids.clear();
+        registry->findGameObjects(near, player->conn->GetPosition(), max_distance);
+        for (GameObject* gameobj : near) {
+            if (checksRelevance(registry, scene, gameobj) && checkRelevance(player, gameobj, show_margin, hidden, shown)) {
+                near_node_ids.insert(gameobj->GetNode()->GetID());
+            }
         }
 
-        // If node was destroyed and it was controlled by somebody, then initiate a respawn
-        if (player && node_was_destroyed) {
-            // If node belongs to a human player, then inform they no longer control it
-            if (player->conn) {
-                Urho3D::VariantMap event_args;
-                event_args[P_ID] = 0;
-                player->conn->SendRemoteEvent(E_TO_CLIENT_SET_CONTROLLED_NODE, true, event_args);
+        // Nodes that were near, but are not anymore, are hidden if they went out of relevance
+        for (unsigned node_id : player->near_node_ids) {
+            if (near_node_ids.count(node_id)) {
+                continue;
             }
-            // Remove controlling
-            node_controllers.erase(node_controllers_find);
-            player->controlled_node_id = 0;
-            // Initiate a respawn
-            player->respawn_at = ::time(NULL) + 4;
+            Urho3D::Node* node = scene->GetNode(node_id);
+            GameObject* gameobj = node ? registry->findGameObject(node) : nullptr;
+            if (gameobj && checksRelevance(registry, scene, gameobj)) {
+                checkRelevance(player, gameobj, show_margin, hidden, shown);
+            }
+        }
+        player->near_node_ids.swap(near_node_ids);
+
+        if (!hidden.Empty() || !shown.Empty()) {
+            Urho3D::VariantMap event_args;
+            event_args[P_HIDDEN] = hidden;
+            event_args[P_SHOWN] = shown;
+            player->conn->SendRemoteEvent(E_TO_CLIENT_RELEVANCE_CHANGED, true, event_args);
         }
     }
+    removed_node_ids.Clear();
+}
 
-    // Run respawns
+bool ServerState::checkRelevance(Player* player, GameObject* gameobj, float show_margin, Urho3D::VariantVector& hidden, Urho3D::VariantVector& shown)
+{
+    unsigned node_id = gameobj->GetNode()->GetID();
+    if (player->hidden_node_ids.count(node_id)) {
+        if (!gameobj->isRelevantTo(player->conn, show_margin)) {
+            return false;
+        }
+        player->hidden_node_ids.erase(node_id);
+        shown.Push(node_id);
+        return true;
+    }
+    if (!gameobj->isRelevantTo(player->conn)) {
+        player->hidden_node_ids.insert(node_id);
+        hidden.Push(node_id);
+        return false;
+    }
+    return true;
+}
+
+void ServerState::sendPredictionAcks()
+{
+    GameObjectRegistry* registry = app->getGameObjectRegistry();
     for (Players::iterator i = players.begin(); i != players.end(); ++ i) {
         Player* player = *i;
-        // If it is time for respawn
-        if (player->respawn_at > 0 && player->respawn_at < ::time(NULL)) {
-            createNodeAndGameObjectForPlayer(player);
-            player->respawn_at = 0;
+        if (!player->conn || !player->controlled_node_id) {
+            continue;
         }
+        Urho3D::Node* node = app->getScene()->GetNode(player->controlled_node_id);
+        GameObject* gameobj = registry->findGameObject(node);
+        if (!gameobj || !gameobj->supportsPrediction()) {
+            continue;
+        }
+
+        // Only clients that predict send sequence numbers
+        Urho3D::VariantMap const& extra_data = player->controls.extraData_;
+        Urho3D::VariantMap::ConstIterator extra_data_find = extra_data.Find(CTRL_EXTRA_SEQUENCE);
+        if (extra_data_find == extra_data.End()) {
+            continue;
+        }
+
+        // Tell which input was applied last, and where it took the Node
+        Urho3D::VariantMap event_args;
+        event_args[P_SEQUENCE] = extra_data_find->second_.GetUInt();
+        event_args[P_POSITION] = node->GetPosition();
+        event_args[P_ROTATION] = node->GetRotation();
+        player->conn->SendRemoteEvent(E_TO_CLIENT_PREDICTION_ACK, false, event_args);
     }
 }
 
+ServerState::TickStats ServerState::popTickStats()
+{
+    TickStats result = tick_stats;
+    tick_stats.ticks = 0;
+    tick_stats.total = 0;
+    tick_stats.max = 0;
+    return result;
+}
+
+NetworkStats& ServerState::getNetworkStats()
+{
+    return network_stats;
+}
+
+uint16_t ServerState::getPort() const
+{
+    return port;
+}
+
 void ServerState::handleClientConnected(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
 {
     (void)event_type;
@@ -212,6 +688,11 @@ void ServerState::handleClientConnected(Urho3D::StringHash event_type, Urho3D::V
 
     conn->SetScene(app->getScene());
 
+    // Client needs to know how often network updates are sent
+    Urho3D::VariantMap event_args;
+    event_args[P_UPDATE_RATE] = GetSubsystem<Urho3D::Network>()->GetUpdateFps();
+    conn->SendRemoteEvent(E_TO_CLIENT_SERVER_INFO, true, event_args);
+
     createNodeAndGameObjectForPlayer(player);
 }
 
@@ -224,85 +705,47 @@ void ServerState::handleClientDisconnected(Urho3D::StringHash event_type, Urho3D
     Player* player = getPlayer(conn);
     assert(player);
 
-    // Clean node controller
+    // Clean node controller and possible respawn
     if (player->controlled_node_id) {
         node_controllers.erase(player->controlled_node_id);
     }
+    if (player->respawn_timer) {
+        app->getGameObjectRegistry()->getTimers().cancel(player->respawn_timer);
+    }
+    app->getGameObjectRegistry()->getLagCompensation().setInterpolationDelay(conn, 0);
     // Clean player
     players.erase(Urho3D::SharedPtr<Player>(player));
 }
 
-void ServerState::handlePhysicsCollision(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+void ServerState::handleCustomNetworkEvent(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
 {
-    (void)event_type;
-
-    // Get nodes
-    Urho3D::Node* original_node_a = dynamic_cast<Urho3D::Node*>(event_data[Urho3D::PhysicsCollision::P_NODEA].GetPtr());
-    Urho3D::Node* original_node_b = dynamic_cast<Urho3D::Node*>(event_data[Urho3D::PhysicsCollision::P_NODEB].GetPtr());
-    Urho3D::Node* node_a = original_node_a;
-    Urho3D::Node* node_b = original_node_b;
-
-    // Try to find GameObjects
-    GameObject* obj_a = nullptr;
-    GameObject* obj_b = nullptr;
-    while (!obj_a && node_a) {
-        auto comps = node_a->GetComponents();
-        for (Urho3D::Component* comp : comps) {
-            obj_a = dynamic_cast<GameObject*>(comp);
-            if (obj_a) break;
-        }
-        if (!obj_a) {
-            node_a = node_a->GetParent();
-        }
-    }
-    while (!obj_b && node_b) {
-        auto comps = node_b->GetComponents();
-        for (Urho3D::Component* comp : comps) {
-            obj_b = dynamic_cast<GameObject*>(comp);
-            if (obj_b) break;
-        }
-        if (!obj_b) {
-            node_b = node_b->GetParent();
-        }
-    }
+    // Get connection from event data
+    Urho3D::Connection* conn = static_cast<Urho3D::Connection*>(event_data[Urho3D::NetworkMessage::P_CONNECTION].GetPtr());
 
-    // If no GameObjects were got, or none of them is interested about collisions, then stop here
-    if ((!obj_a || !obj_a->getHandlesPhysicsCollisions()) && (!obj_b || !obj_b->getHandlesPhysicsCollisions())) {
-        return;
-    }
+    network_stats.addEvent(event_type, event_data);
 
-    // If another of the GameObjects were not found, then restore its Node to original one
-    if (!obj_a) {
-        node_a = original_node_a;
-    }
-    if (!obj_b) {
-        node_b = original_node_b;
-    }
-
-    // Iterate contacts
-    Urho3D::MemoryBuffer contacts(event_data[Urho3D::PhysicsCollision::P_CONTACTS].GetBuffer());
-    while (!contacts.IsEof()) {
-        // Read contact data
-        Urho3D::Vector3 pos = contacts.ReadVector3();
-        Urho3D::Vector3 normal = contacts.ReadVector3();
-        float distance = contacts.ReadFloat();
-        contacts.ReadFloat(); // Impulse
-        // Make a callback to GameObject(s)
-        if (obj_a && obj_a->getHandlesPhysicsCollisions()) {
-            obj_a->handlePhysicsCollision(pos, normal, distance, node_b, obj_b);
-        }
-        if (obj_b && obj_b->getHandlesPhysicsCollisions()) {
-            obj_b->handlePhysicsCollision(pos, -normal, distance, node_a, obj_a);
-        }
-    }
+    app->handleServerNetworkEvent(conn, event_type, event_data);
 }
 
-void ServerState::handleCustomNetworkEvent(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+void ServerState::handleNetworkMessage(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
 {
-    // Get connection from event data
-    Urho3D::Connection* conn = static_cast<Urho3D::Connection*>(event_data[Urho3D::NetworkMessage::P_CONNECTION].GetPtr());
+    (void)event_type;
 
-    app->handleServerNetworkEvent(conn, event_type, event_data);
+    if (event_data[Urho3D::NetworkMessage::P_MESSAGEID].GetInt() != MSG_INPUT) {
+        return;
+    }
+    Urho3D::Connection* conn = static_cast<Urho3D::Connection*>(event_data[Urho3D::NetworkMessage::P_CONNECTION].GetPtr());
+    Player* player = getPlayer(conn);
+    if (!player) {
+        return;
+    }
+    Urho3D::MemoryBuffer buf(event_data[Urho3D::NetworkMessage::P_DATA].GetBuffer());
+    network_stats.addMessage("input", buf.GetSize());
+    if (!player->input.receive(buf)) {
+        URHO3D_LOGWARNING("Received malformed input from client!");
+        return;
+    }
+    app->getGameObjectRegistry()->getLagCompensation().setInterpolationDelay(conn, player->input.getInterpolationDelay());
 }
 
 Player* ServerState::getPlayer(Urho3D::Connection* conn)
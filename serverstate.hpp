@@ -1,10 +1,14 @@
 #ifndef GAMELIB_SERVERSTATE_HPP
 #define GAMELIB_SERVERSTATE_HPP
 
+#include "gameobject.hpp"
+#include "networkstats.hpp"
 #include "player.hpp"
 #include "../urhoextras/states/state.hpp"
 
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Network/Connection.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
 #include <Urho3D/Scene/Scene.h>
 
 #include <map>
@@ -21,12 +25,40 @@ class ServerState : public UrhoExtras::States::State
 
 public:
 
-    ServerState(App* app, Urho3D::Context* context, uint16_t port);
+    // Durations are in nanoseconds
+    struct TickStats
+    {
+        unsigned ticks;
+        uint64_t total;
+        uint64_t max;
+    };
+
+    // If tick rate is zero, then GameObjects are run once per frame with
+    // variable timestep. Otherwise they are run with fixed timestep. If
+    // port is zero, then server does not listen to connections.
+    ServerState(App* app, Urho3D::Context* context, uint16_t port, unsigned tick_rate = 0);
 
     void show() override;
     void hide() override;
     void removed() override;
 
+    // Adds a player without connection and spawns a node for it.
+    // Its controls can be set through the returned Player.
+    Player* addLocalPlayer();
+
+    // Runs one tick of GameObjects, timers, respawns and physics. This is
+    // called when the engine updates, but can also be called directly.
+    void runTick(float deltatime);
+
+    // Returns statistics of ticks that have been run since the previous call
+    TickStats popTickStats();
+
+    // Traffic of client connections
+    NetworkStats& getNetworkStats();
+
+    // Port that server listens to, or zero if it does not listen
+    uint16_t getPort() const;
+
     static void stop();
 
 private:
@@ -36,21 +68,86 @@ private:
     // Mapping from Node to its controller
     typedef std::map<unsigned, Urho3D::SharedPtr<Player> > NodeControllers;
 
+    // GameObject that is run in a worker thread, and its result
+    struct ParallelJob
+    {
+        Urho3D::WeakPtr<GameObject> gameobj;
+        Urho3D::Controls const* controls;
+        bool keep;
+    };
+    typedef Urho3D::Vector<ParallelJob> ParallelJobs;
+
     App* app;
 
+    uint16_t port;
+
     static bool run_server;
 
     Players players;
     NodeControllers node_controllers;
 
+    // Fixed timestep. Zero if variable timestep is used.
+    float tick_length;
+    float tick_accumulator;
+
+    // Time that has been skipped since the last warning about it
+    float skipped_time;
+    float time_since_skip_warning;
+
+    // Stepped by ticks instead of Scene updates
+    Urho3D::WeakPtr<Urho3D::PhysicsWorld> physics;
+
+    ParallelJobs parallel_jobs;
+    float parallel_deltatime;
+
+    TickStats tick_stats;
+
+    NetworkStats network_stats;
+
+    // IDs of root Nodes that have been removed since relevance was checked
+    Urho3D::PODVector<unsigned> removed_node_ids;
+
     void createNodeAndGameObjectForPlayer(Player* player);
 
+    Urho3D::Controls const* getControls(Urho3D::Node* node);
+
+    // Returns Player whose client predicts given Node, or null. Such
+    // Nodes are run once per input of the client instead of per tick.
+    Player* getPredictingPlayer(Urho3D::Node* node);
+
+    // Runs GameObjects of predicted Nodes with queued inputs of their clients
+    void runPredictedNodes(float deltatime);
+
+    // Runs GameObjects of root Node that are not sleeping.
+    // Returns false if the Node should be destroyed.
+    bool runNodeGameObjects(Urho3D::Node* node, float deltatime, Urho3D::Controls const* controls);
+
+    // Destroys node and initiates a respawn if it was controlled by somebody
+    void destroyNode(Urho3D::Node* node);
+
+    // Tells predicting clients where their controlled Nodes are
+    void sendPredictionAcks();
+
+    // Centers relevance of each Connection to its controlled Node
+    void updateRelevanceCenters();
+
+    // Tells clients to hide Nodes that they stopped getting updates
+    // of, and to show them again when updates continue.
+    void sendRelevanceChanges();
+    // Hides or shows Node of GameObject for client of Player, if its relevance
+    // has changed. Returns true if the Node is shown to the client.
+    bool checkRelevance(Player* player, GameObject* gameobj, float show_margin, Urho3D::VariantVector& hidden, Urho3D::VariantVector& shown);
+
+    void runGameObjectsInParallel(float deltatime);
+    static void runParallelJobs(Urho3D::WorkItem const* item, unsigned thread_index);
+
     void handleKeyDown(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleNodeRemoved(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleClientConnected(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleClientDisconnected(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
-    void handlePhysicsCollision(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
     void handleSetPlayerName(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+    void handleNetworkMessage(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
 
     void handleCustomNetworkEvent(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
 
@@ -0,0 +1,277 @@
+#include "snapshotinterpolator.hpp"
+
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Network/NetworkEvents.h>
+
+namespace GameLib
+{
+
+Urho3D::String const NETWORK_POSITION_ATTR = "Network Position";
+Urho3D::String const NETWORK_ROTATION_ATTR = "Network Rotation";
+
+// How fast clock offset and jitter follow new measurements
+double const CLOCK_SMOOTHING = 0.05;
+
+SnapshotInterpolator::SnapshotInterpolator(Urho3D::Context* context) :
+    Urho3D::Object(context),
+    update_interval(1.0f / 30),
+    min_delay(0),
+    jitter_multiplier(2),
+    max_extrapolation(0.25f),
+    time(0),
+    has_timestamp(false),
+    latest_timestamp(0),
+    latest_update(0),
+    latest_update_arrived(0),
+    clock_offset(0),
+    jitter(0)
+{
+    SubscribeToEvent(Urho3D::E_INTERCEPTNETWORKUPDATE, URHO3D_HANDLER(SnapshotInterpolator, handleInterceptNetworkUpdate));
+}
+
+SnapshotInterpolator::~SnapshotInterpolator()
+{
+}
+
+void SnapshotInterpolator::setUpdateInterval(float update_interval)
+{
+    if (update_interval == this->update_interval) {
+        return;
+    }
+    this->update_interval = update_interval;
+
+    // Old timestamps mean different times now, so start over
+    restartClock();
+    jitter = 0;
+}
+
+void SnapshotInterpolator::setDelay(float min_delay, float jitter_multiplier)
+{
+    this->min_delay = min_delay;
+    this->jitter_multiplier = jitter_multiplier;
+}
+
+void SnapshotInterpolator::setMaxExtrapolation(float max_extrapolation)
+{
+    this->max_extrapolation = max_extrapolation;
+}
+
+void SnapshotInterpolator::addNode(Urho3D::Node* node)
+{
+    // Entry might be left from a removed Node whose address got reused
+    TrackedNodes::Iterator nodes_find = nodes.Find(node);
+    if (nodes_find != nodes.End() && !nodes_find->second_.node.Expired()) {
+        return;
+    }
+    TrackedNode& tracked = nodes[node];
+    tracked.node = node;
+    tracked.snapshots_begin = 0;
+    tracked.snapshots_count = 0;
+    tracked.latest_pos = node->GetPosition();
+    tracked.latest_rot = node->GetRotation();
+
+    node->SetInterceptNetworkUpdate(NETWORK_POSITION_ATTR, true);
+    node->SetInterceptNetworkUpdate(NETWORK_ROTATION_ATTR, true);
+}
+
+void SnapshotInterpolator::removeNode(Urho3D::Node* node)
+{
+    TrackedNodes::Iterator nodes_find = nodes.Find(node);
+    if (nodes_find == nodes.End()) {
+        return;
+    }
+
+    // Jump to the latest state from server
+    node->SetInterceptNetworkUpdate(NETWORK_POSITION_ATTR, false);
+    node->SetInterceptNetworkUpdate(NETWORK_ROTATION_ATTR, false);
+    node->SetPosition(nodes_find->second_.latest_pos);
+    node->SetRotation(nodes_find->second_.latest_rot);
+
+    nodes.Erase(nodes_find);
+}
+
+void SnapshotInterpolator::update(float deltatime)
+{
+    time += deltatime;
+
+    double render_time = getRenderTime();
+
+    TrackedNodes::Iterator i = nodes.Begin();
+    while (i != nodes.End()) {
+        if (i->second_.node.Expired()) {
+            i = nodes.Erase(i);
+            continue;
+        }
+        if (i->second_.snapshots_count) {
+            applySnapshots(i->second_, render_time);
+        }
+        ++ i;
+    }
+}
+
+float SnapshotInterpolator::getDelay() const
+{
+    return update_interval + min_delay + jitter * jitter_multiplier;
+}
+
+float SnapshotInterpolator::getJitter() const
+{
+    return jitter;
+}
+
+double SnapshotInterpolator::getRenderTime() const
+{
+    return time - clock_offset - getDelay();
+}
+
+void SnapshotInterpolator::restartClock()
+{
+    has_timestamp = false;
+    for (TrackedNodes::Iterator i = nodes.Begin(); i != nodes.End(); ++ i) {
+        i->second_.snapshots_count = 0;
+    }
+}
+
+void SnapshotInterpolator::addSnapshot(TrackedNode& tracked, double server_time)
+{
+    if (tracked.snapshots_count) {
+        Snapshot& newest = tracked.snapshots[(tracked.snapshots_begin + tracked.snapshots_count - 1) % MAX_SNAPSHOTS];
+        // Position and rotation of the same update
+        if (newest.time == server_time) {
+            newest.pos = tracked.latest_pos;
+            newest.rot = tracked.latest_rot;
+            return;
+        }
+        // If Node has not moved for a while, then it stayed still until
+        // the previous update, instead of moving slowly all that time.
+        if (newest.time < server_time - update_interval * 1.5) {
+            Snapshot still = newest;
+            still.time = server_time - update_interval;
+            pushSnapshot(tracked, still);
+        }
+    }
+
+    Snapshot snapshot;
+    snapshot.time = server_time;
+    snapshot.pos = tracked.latest_pos;
+    snapshot.rot = tracked.latest_rot;
+    pushSnapshot(tracked, snapshot);
+}
+
+void SnapshotInterpolator::pushSnapshot(TrackedNode& tracked, Snapshot const& snapshot)
+{
+    // Forget the oldest snapshot if buffer is full
+    if (tracked.snapshots_count == MAX_SNAPSHOTS) {
+        tracked.snapshots_begin = (tracked.snapshots_begin + 1) % MAX_SNAPSHOTS;
+        -- tracked.snapshots_count;
+    }
+    tracked.snapshots[(tracked.snapshots_begin + tracked.snapshots_count) % MAX_SNAPSHOTS] = snapshot;
+    ++ tracked.snapshots_count;
+}
+
+SnapshotInterpolator::Snapshot const& SnapshotInterpolator::getSnapshot(TrackedNode const& tracked, unsigned index)
+{
+    return tracked.snapshots[(tracked.snapshots_begin + index) % MAX_SNAPSHOTS];
+}
+
+void SnapshotInterpolator::applySnapshots(TrackedNode const& tracked, double render_time) const
+{
+    Urho3D::Node* node = tracked.node;
+    Snapshot const& oldest = getSnapshot(tracked, 0);
+    Snapshot const& newest = getSnapshot(tracked, tracked.snapshots_count - 1);
+
+    Urho3D::Vector3 pos;
+    Urho3D::Quaternion rot;
+    if (render_time <= oldest.time) {
+        pos = oldest.pos;
+        rot = oldest.rot;
+    }
+    // Past the newest snapshot. Keep moving for a while.
+    else if (render_time >= newest.time) {
+        pos = newest.pos;
+        rot = newest.rot;
+        if (tracked.snapshots_count >= 2) {
+            Snapshot const& previous = getSnapshot(tracked, tracked.snapshots_count - 2);
+            double span = newest.time - previous.time;
+            double extrapolation = Urho3D::Min(render_time - newest.time, double(max_extrapolation));
+            if (span > 0) {
+                pos += (newest.pos - previous.pos) * float(extrapolation / span);
+            }
+        }
+    }
+    // Between two snapshots
+    else {
+        unsigned index = 0;
+        while (getSnapshot(tracked, index + 1).time <= render_time) {
+            ++ index;
+        }
+        Snapshot const& a = getSnapshot(tracked, index);
+        Snapshot const& b = getSnapshot(tracked, index + 1);
+        float t = float((render_time - a.time) / (b.time - a.time));
+        pos = a.pos.Lerp(b.pos, t);
+        rot = a.rot.Slerp(b.rot, t);
+    }
+
+    node->SetPosition(pos);
+    node->SetRotation(rot);
+}
+
+void SnapshotInterpolator::handleInterceptNetworkUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data)
+{
+    (void)event_type;
+
+    Urho3D::Serializable* serializable = static_cast<Urho3D::Serializable*>(event_data[Urho3D::InterceptNetworkUpdate::P_SERIALIZABLE].GetPtr());
+    Urho3D::Node* node = dynamic_cast<Urho3D::Node*>(serializable);
+    TrackedNodes::Iterator nodes_find = nodes.Find(node);
+    if (!node || nodes_find == nodes.End()) {
+        return;
+    }
+    TrackedNode& tracked = nodes_find->second_;
+
+    // Unwrap timestamp. Updates may arrive out of order, but not by half of the range.
+    // If nothing has moved for so long that timestamps may have wrapped around,
+    // then they cannot be unwrapped reliably anymore.
+    unsigned timestamp = event_data[Urho3D::InterceptNetworkUpdate::P_TIMESTAMP].GetUInt() & 0xff;
+    if (has_timestamp && time - latest_update_arrived > update_interval * 64) {
+        restartClock();
+    }
+    if (!has_timestamp) {
+        has_timestamp = true;
+        latest_timestamp = timestamp;
+        latest_update = 0;
+        latest_update_arrived = time;
+        clock_offset = time;
+    }
+    int difference = int8_t(uint8_t(timestamp - latest_timestamp));
+    int64_t update = latest_update + difference;
+
+    // Measure clock offset and jitter when an update arrives for the first time
+    if (difference > 0) {
+        latest_timestamp = timestamp;
+        latest_update = update;
+        latest_update_arrived = time;
+        double deviation = time - update * double(update_interval) - clock_offset;
+        clock_offset += deviation * CLOCK_SMOOTHING;
+        jitter += (float(Urho3D::Abs(deviation)) - jitter) * float(CLOCK_SMOOTHING);
+    }
+
+    // Ignore updates that are older than what has already been received
+    double server_time = update * double(update_interval);
+    if (tracked.snapshots_count && server_time < getSnapshot(tracked, tracked.snapshots_count - 1).time) {
+        return;
+    }
+
+    Urho3D::String const& name = event_data[Urho3D::InterceptNetworkUpdate::P_NAME].GetString();
+    Urho3D::Variant const& value = event_data[Urho3D::InterceptNetworkUpdate::P_VALUE];
+    if (name == NETWORK_POSITION_ATTR) {
+        tracked.latest_pos = value.GetVector3();
+    } else if (name == NETWORK_ROTATION_ATTR) {
+        Urho3D::MemoryBuffer buf(value.GetBuffer());
+        tracked.latest_rot = buf.ReadPackedQuaternion();
+    } else {
+        return;
+    }
+    addSnapshot(tracked, server_time);
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef GAMELIB_SNAPSHOTINTERPOLATOR_HPP
+#define GAMELIB_SNAPSHOTINTERPOLATOR_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Scene/Node.h>
+
+#include <cstdint>
+
+namespace GameLib
+{
+
+// Smooths movement of replicated Nodes on client. Position and rotation
+// updates of tracked Nodes are intercepted and buffered with the timestamps
+// of the server network updates they came in. Nodes are then shown where they
+// were a short while ago, interpolated between updates. The delay grows with
+// measured jitter of arrival times. If updates stop coming, movement is
+// extrapolated for a limited time, after which Nodes stop.
+class SnapshotInterpolator : public Urho3D::Object
+{
+    URHO3D_OBJECT(SnapshotInterpolator, Urho3D::Object);
+
+public:
+
+    SnapshotInterpolator(Urho3D::Context* context);
+    virtual ~SnapshotInterpolator();
+
+    // Seconds between network updates of server
+    void setUpdateInterval(float update_interval);
+    // Delay is at least one update interval plus min delay, and
+    // it grows by jitter multiplied by given amount.
+    void setDelay(float min_delay, float jitter_multiplier);
+    void setMaxExtrapolation(float max_extrapolation);
+
+    // Position and rotation of tracked Nodes are only changed by this
+    void addNode(Urho3D::Node* node);
+    void removeNode(Urho3D::Node* node);
+
+    // Moves tracked Nodes. Called by GameState every frame.
+    void update(float deltatime);
+
+    // In seconds
+    float getDelay() const;
+    float getJitter() const;
+
+private:
+
+    static unsigned const MAX_SNAPSHOTS = 8;
+
+    struct Snapshot
+    {
+        double time;
+        Urho3D::Vector3 pos;
+        Urho3D::Quaternion rot;
+    };
+
+    struct TrackedNode
+    {
+        Urho3D::WeakPtr<Urho3D::Node> node;
+        // Ring buffer from oldest to newest
+        Snapshot snapshots[MAX_SNAPSHOTS];
+        unsigned snapshots_begin;
+        unsigned snapshots_count;
+        // Position and rotation arrive separately
+        Urho3D::Vector3 latest_pos;
+        Urho3D::Quaternion latest_rot;
+    };
+
+    typedef Urho3D::HashMap<Urho3D::Node*, TrackedNode> TrackedNodes;
+
+    TrackedNodes nodes;
+
+    float update_interval;
+    float min_delay;
+    float jitter_multiplier;
+    float max_extrapolation;
+
+    // Local time, advanced by update()
+    double time;
+
+    // Timestamps of network updates are eight bits, so
+    // they are unwrapped to a continuous count of updates.
+    bool has_timestamp;
+    unsigned latest_timestamp;
+    int64_t latest_update;
+    // Local time when the latest update arrived
+    double latest_update_arrived;
+
+    // Difference between local and server time, and average deviation from it
+    double clock_offset;
+    float jitter;
+
+    double getRenderTime() const;
+
+    // Forgets timestamps and snapshots
+    void restartClock();
+
+    // Adds snapshot from the latest position and rotation
+    void addSnapshot(TrackedNode& tracked, double server_time);
+    static void pushSnapshot(TrackedNode& tracked, Snapshot const& snapshot);
+    static Snapshot const& getSnapshot(TrackedNode const& tracked, unsigned index);
+    void applySnapshots(TrackedNode const& tracked, double render_time) const;
+
+    void handleInterceptNetworkUpdate(Urho3D::StringHash event_type, Urho3D::VariantMap& event_data);
+};
+
+}
+
+#endif
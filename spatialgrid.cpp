@@ -0,0 +1,259 @@
+#include "spatialgrid.hpp"
+
+#include <Urho3D/Container/Sort.h>
+
+#include <cassert>
+
+namespace GameLib
+{
+
+// Cell coordinates are packed to 21 bits each
+int const CELL_COORD_BITS = 21;
+int const CELL_COORD_LIMIT = (1 << (CELL_COORD_BITS - 1)) - 1;
+
+SpatialGrid::SpatialGrid(float cell_size) :
+    cell_size(cell_size),
+    items_count(0)
+{
+}
+
+void SpatialGrid::setCellSize(float cell_size)
+{
+    assert(cell_size > 0);
+    this->cell_size = cell_size;
+
+    cells.Clear();
+    for (unsigned i = 0; i < items.Size(); ++ i) {
+        if (items[i].gameobj) {
+            addToCell(i);
+        }
+    }
+}
+
+float SpatialGrid::getCellSize() const
+{
+    return cell_size;
+}
+
+unsigned SpatialGrid::insert(GameObject* gameobj, Urho3D::Vector3 const& pos)
+{
+    assert(gameobj);
+    unsigned item;
+    if (!free_items.Empty()) {
+        item = free_items.Back();
+        free_items.Pop();
+    } else {
+        item = items.Size();
+        items.Resize(item + 1);
+    }
+    ++ items_count;
+
+    items[item].gameobj = gameobj;
+    items[item].pos = pos;
+    addToCell(item);
+
+    return item;
+}
+
+void SpatialGrid::move(unsigned item, Urho3D::Vector3 const& pos)
+{
+    assert(item < items.Size() && items[item].gameobj);
+    Item& moved = items[item];
+    moved.pos = pos;
+
+    int x, y, z;
+    getCellCoords(x, y, z, pos);
+    if (getCellKey(x, y, z) != moved.cell) {
+        removeFromCell(item);
+        addToCell(item);
+    }
+}
+
+void SpatialGrid::remove(unsigned item)
+{
+    assert(item < items.Size() && items[item].gameobj);
+    removeFromCell(item);
+    items[item].gameobj = nullptr;
+    free_items.Push(item);
+    -- items_count;
+}
+
+unsigned SpatialGrid::getNumItems() const
+{
+    return items_count;
+}
+
+void SpatialGrid::findInSphere(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& center, float radius) const
+{
+    Urho3D::BoundingBox box(center - Urho3D::Vector3::ONE * radius, center + Urho3D::Vector3::ONE * radius);
+    float radius_sqr = radius * radius;
+    forEachItemInBox(box, [&](Item const& item) {
+        if ((item.pos - center).LengthSquared() <= radius_sqr) {
+            result.Push(item.gameobj);
+        }
+    });
+}
+
+void SpatialGrid::findInBox(Urho3D::PODVector<GameObject*>& result, Urho3D::BoundingBox const& box) const
+{
+    forEachItemInBox(box, [&](Item const& item) {
+        if (box.IsInside(item.pos) != Urho3D::OUTSIDE) {
+            result.Push(item.gameobj);
+        }
+    });
+}
+
+void SpatialGrid::findNearest(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& pos, unsigned count, float max_distance) const
+{
+    if (!count || !items_count) {
+        return;
+    }
+
+    float max_distance_sqr = max_distance < Urho3D::M_INFINITY ? max_distance * max_distance : Urho3D::M_INFINITY;
+    Candidates candidates;
+
+    // Visit cells in growing rings around the cell of the position. After
+    // ring N, no unvisited item can be closer than N cells, so the search
+    // can stop when enough items closer than that have been found.
+    int center_x, center_y, center_z;
+    getCellCoords(center_x, center_y, center_z, pos);
+    unsigned visited_items = 0;
+    for (int ring = 0; ; ++ ring) {
+        // If ring has more cells than there are non-empty cells, then
+        // it is faster to just go through all of the remaining cells.
+        unsigned ring_side = 2 * ring + 1;
+        if (ring_side * ring_side * ring_side > cells.Size()) {
+            candidates.Clear();
+            for (Cells::ConstIterator i = cells.Begin(); i != cells.End(); ++ i) {
+                addCandidates(candidates, i->second_, pos, max_distance_sqr);
+            }
+            break;
+        }
+
+        for (int x = -ring; x <= ring; ++ x) {
+            for (int y = -ring; y <= ring; ++ y) {
+                for (int z = -ring; z <= ring; ++ z) {
+                    if (Urho3D::Abs(x) != ring && Urho3D::Abs(y) != ring && Urho3D::Abs(z) != ring) {
+                        continue;
+                    }
+                    Cells::ConstIterator cells_find = cells.Find(getCellKey(center_x + x, center_y + y, center_z + z));
+                    if (cells_find != cells.End()) {
+                        addCandidates(candidates, cells_find->second_, pos, max_distance_sqr);
+                        visited_items += cells_find->second_.Size();
+                    }
+                }
+            }
+        }
+
+        float searched_distance = ring * cell_size;
+        if (visited_items >= items_count || searched_distance >= max_distance) {
+            break;
+        }
+        if (candidates.Size() >= count) {
+            Urho3D::Sort(candidates.Begin(), candidates.End(), compareCandidates);
+            if (candidates[count - 1].distance_sqr <= searched_distance * searched_distance) {
+                break;
+            }
+        }
+    }
+
+    Urho3D::Sort(candidates.Begin(), candidates.End(), compareCandidates);
+    for (unsigned i = 0; i < candidates.Size() && i < count; ++ i) {
+        result.Push(candidates[i].gameobj);
+    }
+}
+
+void SpatialGrid::getCellCoords(int& result_x, int& result_y, int& result_z, Urho3D::Vector3 const& pos) const
+{
+    // Clamp before converting to integers, so infinite positions work too
+    float const LIMIT = float(CELL_COORD_LIMIT);
+    result_x = int(Urho3D::Clamp(Urho3D::Floor(pos.x_ / cell_size), -LIMIT, LIMIT));
+    result_y = int(Urho3D::Clamp(Urho3D::Floor(pos.y_ / cell_size), -LIMIT, LIMIT));
+    result_z = int(Urho3D::Clamp(Urho3D::Floor(pos.z_ / cell_size), -LIMIT, LIMIT));
+}
+
+SpatialGrid::CellKey SpatialGrid::getCellKey(int x, int y, int z)
+{
+    CellKey const MASK = (CellKey(1) << CELL_COORD_BITS) - 1;
+    return (CellKey(x) & MASK) | ((CellKey(y) & MASK) << CELL_COORD_BITS) | ((CellKey(z) & MASK) << (2 * CELL_COORD_BITS));
+}
+
+void SpatialGrid::addToCell(unsigned item)
+{
+    Item& added = items[item];
+    int x, y, z;
+    getCellCoords(x, y, z, added.pos);
+    added.cell = getCellKey(x, y, z);
+    ItemIds& cell_items = cells[added.cell];
+    added.index_in_cell = cell_items.Size();
+    cell_items.Push(item);
+}
+
+void SpatialGrid::removeFromCell(unsigned item)
+{
+    Item& removed = items[item];
+    Cells::Iterator cells_find = cells.Find(removed.cell);
+    assert(cells_find != cells.End());
+    ItemIds& cell_items = cells_find->second_;
+
+    // Move the last item to the place of the removed one
+    unsigned last = cell_items.Back();
+    cell_items[removed.index_in_cell] = last;
+    items[last].index_in_cell = removed.index_in_cell;
+    cell_items.Pop();
+
+    // Do not keep empty cells around
+    if (cell_items.Empty()) {
+        cells.Erase(cells_find);
+    }
+}
+
+template <typename Callback> void SpatialGrid::forEachItemInBox(Urho3D::BoundingBox const& box, Callback callback) const
+{
+    int min_x, min_y, min_z;
+    int max_x, max_y, max_z;
+    getCellCoords(min_x, min_y, min_z, box.min_);
+    getCellCoords(max_x, max_y, max_z, box.max_);
+
+    double cells_in_box = double(max_x - min_x + 1) * (max_y - min_y + 1) * (max_z - min_z + 1);
+    if (cells_in_box > cells.Size()) {
+        for (Cells::ConstIterator i = cells.Begin(); i != cells.End(); ++ i) {
+            for (unsigned item : i->second_) {
+                callback(items[item]);
+            }
+        }
+        return;
+    }
+
+    for (int x = min_x; x <= max_x; ++ x) {
+        for (int y = min_y; y <= max_y; ++ y) {
+            for (int z = min_z; z <= max_z; ++ z) {
+                Cells::ConstIterator cells_find = cells.Find(getCellKey(x, y, z));
+                if (cells_find != cells.End()) {
+                    for (unsigned item : cells_find->second_) {
+                        callback(items[item]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool SpatialGrid::compareCandidates(Candidate const& a, Candidate const& b)
+{
+    return a.distance_sqr < b.distance_sqr;
+}
+
+void SpatialGrid::addCandidates(Candidates& candidates, ItemIds const& cell_items, Urho3D::Vector3 const& pos, float max_distance_sqr) const
+{
+    for (unsigned item : cell_items) {
+        Candidate candidate;
+        candidate.distance_sqr = (items[item].pos - pos).LengthSquared();
+        if (candidate.distance_sqr <= max_distance_sqr) {
+            candidate.gameobj = items[item].gameobj;
+            candidates.Push(candidate);
+        }
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef GAMELIB_SPATIALGRID_HPP
+#define GAMELIB_SPATIALGRID_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+namespace GameLib
+{
+
+class GameObject;
+
+// Uniform grid of GameObjects by their position. Only cells that contain
+// something are stored, so the world can be of any size. Inserting, moving
+// and removing are constant time, and queries only visit nearby cells.
+class SpatialGrid
+{
+
+public:
+
+    static unsigned const NO_ITEM = 0xffffffff;
+
+    SpatialGrid(float cell_size = 16);
+
+    // Changing cell size rebuilds the grid
+    void setCellSize(float cell_size);
+    float getCellSize() const;
+
+    // Returns ID that is used when moving and removing
+    unsigned insert(GameObject* gameobj, Urho3D::Vector3 const& pos);
+    void move(unsigned item, Urho3D::Vector3 const& pos);
+    void remove(unsigned item);
+
+    unsigned getNumItems() const;
+
+    // Results are appended to the given array
+    void findInSphere(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& center, float radius) const;
+    void findInBox(Urho3D::PODVector<GameObject*>& result, Urho3D::BoundingBox const& box) const;
+
+    // Finds given amount of closest GameObjects, sorted by distance. Results are appended.
+    void findNearest(Urho3D::PODVector<GameObject*>& result, Urho3D::Vector3 const& pos, unsigned count, float max_distance = Urho3D::M_INFINITY) const;
+
+private:
+
+    typedef unsigned long long CellKey;
+
+    struct Item
+    {
+        GameObject* gameobj;
+        Urho3D::Vector3 pos;
+        CellKey cell;
+        unsigned index_in_cell;
+    };
+
+    struct Candidate
+    {
+        float distance_sqr;
+        GameObject* gameobj;
+    };
+
+    typedef Urho3D::PODVector<Item> Items;
+    typedef Urho3D::PODVector<unsigned> ItemIds;
+    typedef Urho3D::HashMap<CellKey, ItemIds> Cells;
+    typedef Urho3D::PODVector<Candidate> Candidates;
+
+    float cell_size;
+
+    Items items;
+    ItemIds free_items;
+    unsigned items_count;
+
+    Cells cells;
+
+    void getCellCoords(int& result_x, int& result_y, int& result_z, Urho3D::Vector3 const& pos) const;
+    static CellKey getCellKey(int x, int y, int z);
+
+    void addToCell(unsigned item);
+    void removeFromCell(unsigned item);
+
+    // Calls callback with every item in cells that touch the box. If the box
+    // covers more cells than there are non-empty ones, all cells are visited.
+    template <typename Callback> void forEachItemInBox(Urho3D::BoundingBox const& box, Callback callback) const;
+
+    static bool compareCandidates(Candidate const& a, Candidate const& b);
+
+    void addCandidates(Candidates& candidates, ItemIds const& cell_items, Urho3D::Vector3 const& pos, float max_distance_sqr) const;
+};
+
+}
+
+#endif
@@ -16,6 +16,10 @@ public:
 
     bool runServerSide(float deltatime, Urho3D::Controls const* controls) override;
 
+    bool supportsPrediction() const override;
+
+    void runPrediction(float deltatime, Urho3D::Controls const& controls) override;
+
     void modifyControls(Urho3D::Controls* controls) const override;
 
     Urho3D::Matrix3x4 getCameraTransform(Urho3D::Controls const* controls) const override;
@@ -24,6 +28,8 @@ public:
 
 private:
 
+    // Shared by server and client prediction
+    void move(float deltatime, Urho3D::Controls const& controls);
 };
 
 }
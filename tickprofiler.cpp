@@ -0,0 +1,244 @@
+#include "tickprofiler.hpp"
+
+#include <Urho3D/IO/Log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace GameLib
+{
+
+bool TickProfiler::enabled = false;
+float TickProfiler::log_interval = 0;
+float TickProfiler::log_timer = 0;
+TickProfiler::TypesStats TickProfiler::types_stats;
+TickProfiler::ThreadStats TickProfiler::threads_stats[MAX_THREADS];
+Urho3D::Mutex TickProfiler::mutex;
+
+void TickProfiler::setEnabled(bool enabled)
+{
+    if (enabled && !TickProfiler::enabled) {
+        reset();
+    }
+    TickProfiler::enabled = enabled;
+}
+
+bool TickProfiler::isEnabled()
+{
+    return enabled;
+}
+
+void TickProfiler::setLogInterval(float interval)
+{
+    log_interval = interval;
+    log_timer = 0;
+}
+
+void TickProfiler::update(float deltatime)
+{
+    if (!enabled) {
+        return;
+    }
+    merge();
+    if (log_interval <= 0) {
+        return;
+    }
+    log_timer += deltatime;
+    if (log_timer >= log_interval) {
+        logSummary();
+        reset();
+    }
+}
+
+void TickProfiler::getTypes(Urho3D::PODVector<Urho3D::StringHash>& result)
+{
+    merge();
+    result.Clear();
+    for (TypesStats::ConstIterator i = types_stats.Begin(); i != types_stats.End(); ++ i) {
+        result.Push(i->first_);
+    }
+}
+
+TickProfiler::Stats TickProfiler::getStats(Urho3D::StringHash const& type, Call call)
+{
+    merge();
+
+    Stats result;
+    ::memset(&result, 0, sizeof(result));
+
+    TypesStats::ConstIterator types_stats_find = types_stats.Find(type);
+    if (types_stats_find == types_stats.End()) {
+        return result;
+    }
+    CallStats const& stats = types_stats_find->second_.calls[call];
+    result.count = stats.count;
+    result.total = stats.total;
+    result.p50 = getPercentile(stats, 0.5);
+    result.p99 = getPercentile(stats, 0.99);
+    result.max = stats.max;
+    return result;
+}
+
+void TickProfiler::logSummary()
+{
+    merge();
+
+    // Sort by total time, so the most expensive calls are logged first
+    typedef std::pair<uint64_t, Urho3D::String> Line;
+    std::vector<Line> lines;
+    for (TypesStats::ConstIterator i = types_stats.Begin(); i != types_stats.End(); ++ i) {
+        TypeStats const& type_stats = i->second_;
+        for (unsigned call = 0; call < CALLS_COUNT; ++ call) {
+            CallStats const& stats = type_stats.calls[call];
+            if (!stats.count) {
+                continue;
+            }
+            Urho3D::String line;
+            line.AppendWithFormat(
+                "%s::%s: %u calls, total %.3f ms, p50 %.2f us, p99 %.2f us, max %.2f us",
+                type_stats.name.CString(), getCallName(Call(call)), stats.count, stats.total / 1000000.0,
+                getPercentile(stats, 0.5) / 1000.0, getPercentile(stats, 0.99) / 1000.0, stats.max / 1000.0
+            );
+            lines.push_back(Line(stats.total, line));
+        }
+    }
+    std::sort(lines.begin(), lines.end(), [](Line const& a, Line const& b) {
+        return a.first > b.first;
+    });
+
+    URHO3D_LOGINFOF("Tick profile of last %.1f seconds:", log_timer);
+    for (Line const& line : lines) {
+        URHO3D_LOGINFO("  " + line.second);
+    }
+}
+
+void TickProfiler::reset()
+{
+    types_stats.Clear();
+    for (unsigned i = 0; i < MAX_THREADS; ++ i) {
+        threads_stats[i].types_stats.Clear();
+    }
+    log_timer = 0;
+}
+
+char const* TickProfiler::getCallName(Call call)
+{
+    switch (call) {
+    case RUN_SERVER_SIDE:
+        return "runServerSide";
+    case RUN_CLIENT_SIDE:
+        return "runClientSide";
+    case HANDLE_PHYSICS_COLLISION:
+        return "handlePhysicsCollisions";
+    case HANDLE_HITSCAN:
+        return "handleHitscan";
+    case HANDLE_EXPLOSION:
+        return "handleExplosion";
+    default:
+        return "unknown";
+    }
+}
+
+void TickProfiler::record(Urho3D::TypeInfo const* type_info, Call call, std::chrono::steady_clock::duration duration, unsigned thread_index)
+{
+    uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+
+    // Only the shared last statistics need locking
+    bool shared = thread_index >= MAX_THREADS - 1;
+    if (shared) {
+        thread_index = MAX_THREADS - 1;
+        mutex.Acquire();
+    }
+
+    TypesStats& thread_types_stats = threads_stats[thread_index].types_stats;
+    CallStats& stats = getTypeStats(thread_types_stats, type_info->GetType(), type_info->GetTypeName()).calls[call];
+    ++ stats.count;
+    stats.total += nanoseconds;
+    stats.max = Urho3D::Max(stats.max, nanoseconds);
+    ++ stats.buckets[getBucket(nanoseconds)];
+
+    if (shared) {
+        mutex.Release();
+    }
+}
+
+void TickProfiler::merge()
+{
+    // Types are kept in statistics of threads, so
+    // recording does not allocate after the first calls.
+    for (unsigned i = 0; i < MAX_THREADS; ++ i) {
+        TypesStats& thread_types_stats = threads_stats[i].types_stats;
+        for (TypesStats::Iterator j = thread_types_stats.Begin(); j != thread_types_stats.End(); ++ j) {
+            TypeStats& type_stats = getTypeStats(types_stats, j->first_, j->second_.name);
+            for (unsigned call = 0; call < CALLS_COUNT; ++ call) {
+                CallStats const& src = j->second_.calls[call];
+                if (!src.count) {
+                    continue;
+                }
+                CallStats& dest = type_stats.calls[call];
+                dest.count += src.count;
+                dest.total += src.total;
+                dest.max = Urho3D::Max(dest.max, src.max);
+                for (unsigned bucket = 0; bucket < BUCKETS; ++ bucket) {
+                    dest.buckets[bucket] += src.buckets[bucket];
+                }
+            }
+            ::memset(j->second_.calls, 0, sizeof(j->second_.calls));
+        }
+    }
+}
+
+TickProfiler::TypeStats& TickProfiler::getTypeStats(TypesStats& stats, Urho3D::StringHash const& type, Urho3D::String const& name)
+{
+    TypesStats::Iterator stats_find = stats.Find(type);
+    if (stats_find == stats.End()) {
+        TypeStats new_type_stats;
+        new_type_stats.name = name;
+        ::memset(new_type_stats.calls, 0, sizeof(new_type_stats.calls));
+        stats_find = stats.Insert(Urho3D::MakePair(type, new_type_stats));
+    }
+    return stats_find->second_;
+}
+
+unsigned TickProfiler::getBucket(uint64_t duration)
+{
+    if (duration < SUB_BUCKETS) {
+        return unsigned(duration);
+    }
+    // Find the power of two, and then the position between it and the next one
+    unsigned exponent = 0;
+    for (uint64_t i = duration; i > 1; i >>= 1) {
+        ++ exponent;
+    }
+    unsigned sub_bucket = unsigned(duration >> (exponent - 2)) & (SUB_BUCKETS - 1);
+    return Urho3D::Min((exponent - 1) * SUB_BUCKETS + sub_bucket, BUCKETS - 1);
+}
+
+uint64_t TickProfiler::getBucketUpperLimit(unsigned bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    unsigned exponent = bucket / SUB_BUCKETS + 1;
+    uint64_t sub_bucket_size = uint64_t(1) << (exponent - 2);
+    return (uint64_t(1) << exponent) + (bucket % SUB_BUCKETS + 1) * sub_bucket_size;
+}
+
+uint64_t TickProfiler::getPercentile(CallStats const& stats, float percentile)
+{
+    if (!stats.count) {
+        return 0;
+    }
+    unsigned limit = unsigned(Urho3D::Ceil(stats.count * percentile));
+    unsigned count = 0;
+    for (unsigned bucket = 0; bucket < BUCKETS; ++ bucket) {
+        count += stats.buckets[bucket];
+        if (count >= limit) {
+            return Urho3D::Min(getBucketUpperLimit(bucket), stats.max);
+        }
+    }
+    return stats.max;
+}
+
+}
@@ -0,0 +1,158 @@
+#ifndef GAMELIB_TICKPROFILER_HPP
+#define GAMELIB_TICKPROFILER_HPP
+
+#include "gameobject.hpp"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Core/Mutex.h>
+
+#include <chrono>
+#include <cstdint>
+
+namespace GameLib
+{
+
+// Measures how long GameObject callbacks take, grouped by GameObject type. When
+// disabled, measuring costs only one check of a flag. Statistics are collected
+// over a window that starts when profiler is enabled, reset or summary logged.
+// Every WorkQueue thread records into its own statistics without locking, and
+// they are merged when statistics are read. Statistics must only be read,
+// updated and reset on the main thread, when no worker threads are running.
+class TickProfiler
+{
+
+public:
+
+    enum Call
+    {
+        RUN_SERVER_SIDE,
+        RUN_CLIENT_SIDE,
+        HANDLE_PHYSICS_COLLISION,
+        HANDLE_HITSCAN,
+        HANDLE_EXPLOSION,
+        CALLS_COUNT
+    };
+
+    // Durations are in nanoseconds. Percentiles are
+    // approximations with an error of about 20 %.
+    struct Stats
+    {
+        unsigned count;
+        uint64_t total;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t max;
+    };
+
+    // Measures the lifetime of the scope as one call of GameObject
+    class Scope
+    {
+
+    public:
+
+        // Only the type of GameObject is stored, so the GameObject may get
+        // destroyed during the call. Thread index is the one WorkQueue gives
+        // to work functions. Main thread is zero.
+        inline Scope(GameObject const* gameobj, Call call, unsigned thread_index = 0) :
+            type_info(enabled ? gameobj->GetTypeInfo() : nullptr),
+            call(call),
+            thread_index(thread_index)
+        {
+            if (type_info) {
+                begin = std::chrono::steady_clock::now();
+            }
+        }
+
+        inline ~Scope()
+        {
+            if (type_info) {
+                record(type_info, call, std::chrono::steady_clock::now() - begin, thread_index);
+            }
+        }
+
+    private:
+
+        Urho3D::TypeInfo const* type_info;
+        Call call;
+        unsigned thread_index;
+        std::chrono::steady_clock::time_point begin;
+    };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // If interval is positive, a summary is written to log every
+    // that many seconds, after which the statistics are reset.
+    static void setLogInterval(float interval);
+
+    // This is called by ServerState and GameState once per tick
+    static void update(float deltatime);
+
+    static void getTypes(Urho3D::PODVector<Urho3D::StringHash>& result);
+    static Stats getStats(Urho3D::StringHash const& type, Call call);
+
+    static void logSummary();
+
+    static void reset();
+
+    static char const* getCallName(Call call);
+
+private:
+
+    // Durations are stored in buckets that grow exponentially.
+    // Each power of two is split into four buckets.
+    static unsigned const SUB_BUCKETS = 4;
+    static unsigned const BUCKETS = 41 * SUB_BUCKETS;
+
+    // Threads with higher indices share the last statistics
+    static unsigned const MAX_THREADS = 64;
+
+    struct CallStats
+    {
+        unsigned count;
+        uint64_t total;
+        uint64_t max;
+        unsigned buckets[BUCKETS];
+    };
+
+    struct TypeStats
+    {
+        Urho3D::String name;
+        CallStats calls[CALLS_COUNT];
+    };
+
+    typedef Urho3D::HashMap<Urho3D::StringHash, TypeStats> TypesStats;
+
+    // Aligned to cache lines, so threads do not slow each other down
+    struct alignas(64) ThreadStats
+    {
+        TypesStats types_stats;
+    };
+
+    static bool enabled;
+    static float log_interval;
+    static float log_timer;
+
+    // Merged statistics of all threads
+    static TypesStats types_stats;
+    // Statistics that have been recorded since the previous merge
+    static ThreadStats threads_stats[MAX_THREADS];
+
+    // Locks the last statistics, which can be shared by many threads
+    static Urho3D::Mutex mutex;
+
+    static void record(Urho3D::TypeInfo const* type_info, Call call, std::chrono::steady_clock::duration duration, unsigned thread_index);
+
+    // Moves statistics of threads to the merged statistics
+    static void merge();
+
+    static TypeStats& getTypeStats(TypesStats& stats, Urho3D::StringHash const& type, Urho3D::String const& name);
+
+    static unsigned getBucket(uint64_t duration);
+    static uint64_t getBucketUpperLimit(unsigned bucket);
+    static uint64_t getPercentile(CallStats const& stats, float percentile);
+};
+
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include "timerwheel.hpp"
+
+#include <cassert>
+
+namespace GameLib
+{
+
+TimerWheel::TimerWheel() :
+    time(0),
+    time_remainder(0),
+    timers_count(0)
+{
+    for (unsigned i = 0; i < LISTS; ++ i) {
+        heads[i] = NONE;
+    }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t delay, Callback const& callback)
+{
+    // Get a free Timer
+    unsigned index;
+    if (!free_timers.empty()) {
+        index = free_timers.back();
+        free_timers.pop_back();
+    } else {
+        index = timers.size();
+        timers.push_back(Timer());
+        timers.back().generation = 1;
+    }
+    ++ timers_count;
+
+    Timer& timer = timers[index];
+    timer.fire_at = time + (delay > 0 ? delay : 1);
+    timer.callback = callback;
+    insert(index);
+
+    return (TimerId(timer.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    unsigned index = unsigned(id & 0xffffffff);
+    uint32_t generation = uint32_t(id >> 32);
+    if (index >= timers.size() || timers[index].generation != generation || timers[index].list == NONE) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+void TimerWheel::advance(uint64_t milliseconds)
+{
+    for (uint64_t i = 0; i < milliseconds; ++ i) {
+        ++ time;
+
+        // When the lowest level wraps around, move timers down from higher levels
+        unsigned slot = time & SLOT_MASK;
+        if (slot == 0) {
+            for (unsigned level = 1; level < LEVELS; ++ level) {
+                if (cascade(level) != 0) {
+                    break;
+                }
+            }
+        }
+
+        // Move due timers to firing list. This way callbacks can
+        // cancel other due timers, and new timers are not fired.
+        if (heads[slot] == NONE) {
+            continue;
+        }
+        while (heads[slot] != NONE) {
+            unsigned index = heads[slot];
+            unlink(index);
+            link(index, FIRING_LIST);
+        }
+
+        // Fire. Timer is released before calling the callback,
+        // so the callback can reschedule using the same storage.
+        while (heads[FIRING_LIST] != NONE) {
+            unsigned index = heads[FIRING_LIST];
+            unlink(index);
+            Callback callback;
+            callback.swap(timers[index].callback);
+            release(index);
+            callback();
+        }
+    }
+}
+
+void TimerWheel::advanceSeconds(float seconds)
+{
+    time_remainder += seconds * 1000;
+    uint64_t milliseconds = uint64_t(time_remainder);
+    time_remainder -= milliseconds;
+    advance(milliseconds);
+}
+
+uint64_t TimerWheel::getTime() const
+{
+    return time;
+}
+
+unsigned TimerWheel::getNumTimers() const
+{
+    return timers_count;
+}
+
+void TimerWheel::insert(unsigned index)
+{
+    Timer& timer = timers[index];
+
+    // Timers too far in the future are clamped to the range of the wheel
+    uint64_t const MAX_DELAY = (uint64_t(1) << (LEVELS * SLOT_BITS)) - 1;
+    if (timer.fire_at < time) {
+        timer.fire_at = time;
+    } else if (timer.fire_at - time > MAX_DELAY) {
+        timer.fire_at = time + MAX_DELAY;
+    }
+
+    // Find the lowest level that can hold the timer
+    uint64_t delay = timer.fire_at - time;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delay >= (uint64_t(1) << ((level + 1) * SLOT_BITS))) {
+        ++ level;
+    }
+    unsigned slot = (timer.fire_at >> (level * SLOT_BITS)) & SLOT_MASK;
+
+    link(index, level * SLOTS + slot);
+}
+
+void TimerWheel::link(unsigned index, unsigned list)
+{
+    Timer& timer = timers[index];
+    timer.list = list;
+    timer.prev = NONE;
+    timer.next = heads[list];
+    if (timer.next != NONE) {
+        timers[timer.next].prev = index;
+    }
+    heads[list] = index;
+}
+
+void TimerWheel::unlink(unsigned index)
+{
+    Timer& timer = timers[index];
+    assert(timer.list != NONE);
+    if (timer.prev != NONE) {
+        timers[timer.prev].next = timer.next;
+    } else {
+        heads[timer.list] = timer.next;
+    }
+    if (timer.next != NONE) {
+        timers[timer.next].prev = timer.prev;
+    }
+    timer.list = NONE;
+}
+
+void TimerWheel::release(unsigned index)
+{
+    Timer& timer = timers[index];
+    timer.callback = Callback();
+    ++ timer.generation;
+    if (!timer.generation) {
+        timer.generation = 1;
+    }
+    free_timers.push_back(index);
+    -- timers_count;
+}
+
+unsigned TimerWheel::cascade(unsigned level)
+{
+    unsigned slot = (time >> (level * SLOT_BITS)) & SLOT_MASK;
+    unsigned list = level * SLOTS + slot;
+    while (heads[list] != NONE) {
+        unsigned index = heads[list];
+        unlink(index);
+        insert(index);
+    }
+    return slot;
+}
+
+}
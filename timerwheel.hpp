@@ -0,0 +1,93 @@
+#ifndef GAMELIB_TIMERWHEEL_HPP
+#define GAMELIB_TIMERWHEEL_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace GameLib
+{
+
+// Hierarchical timer wheel with millisecond resolution. Timers are kept in
+// four levels of 256 slots, and are moved to lower levels as their time gets
+// closer. Scheduling and cancelling are constant time, and advancing time only
+// costs the timers that are due, plus a small constant per millisecond.
+class TimerWheel
+{
+
+public:
+
+    // Zero is never a valid ID
+    typedef uint64_t TimerId;
+
+    typedef std::function<void()> Callback;
+
+    TimerWheel();
+
+    // Callback is called when at least the given amount of milliseconds has
+    // passed. Delays shorter than one millisecond are rounded up to it.
+    TimerId schedule(uint64_t delay, Callback const& callback);
+
+    // Returns false if timer has already fired or been cancelled
+    bool cancel(TimerId id);
+
+    // Advances time and calls the callbacks of timers that became due. Callbacks
+    // are allowed to schedule and cancel timers, including their own.
+    void advance(uint64_t milliseconds);
+    // Same, but fractions of milliseconds are carried over to the next call
+    void advanceSeconds(float seconds);
+
+    uint64_t getTime() const;
+
+    unsigned getNumTimers() const;
+
+private:
+
+    static unsigned const LEVELS = 4;
+    static unsigned const SLOT_BITS = 8;
+    static unsigned const SLOTS = 1 << SLOT_BITS;
+    static unsigned const SLOT_MASK = SLOTS - 1;
+
+    // Lists of slots, plus a list for timers that are being fired
+    static unsigned const FIRING_LIST = LEVELS * SLOTS;
+    static unsigned const LISTS = FIRING_LIST + 1;
+
+    static unsigned const NONE = 0xffffffff;
+
+    struct Timer
+    {
+        uint64_t fire_at;
+        Callback callback;
+        // Generation is increased every time the Timer is released,
+        // so old IDs do not match to reused Timers.
+        uint32_t generation;
+        unsigned list;
+        unsigned prev;
+        unsigned next;
+    };
+    typedef std::vector<Timer> Timers;
+    typedef std::vector<unsigned> Indices;
+
+    uint64_t time;
+    // Fraction of millisecond that advanceSeconds() has not yet advanced
+    float time_remainder;
+
+    Timers timers;
+    Indices free_timers;
+    unsigned timers_count;
+
+    unsigned heads[LISTS];
+
+    void insert(unsigned index);
+    void link(unsigned index, unsigned list);
+    void unlink(unsigned index);
+    void release(unsigned index);
+
+    // Moves the timers of current slot of given level to lower
+    // levels. Returns the index of the slot that was cascaded.
+    unsigned cascade(unsigned level);
+};
+
+}
+
+#endif